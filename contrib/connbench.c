@@ -0,0 +1,318 @@
+/*
+ * Copyright (C) 2011 Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+
+#include <config.h>
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_STDARG_H
+#include <stdarg.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+
+#ifdef HAVE_ARPA_INET_H
+#include <arpa/inet.h>
+#endif
+
+#ifdef TIME_WITH_SYS_TIME
+#include <time.h>
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#else
+#include <time.h>
+#endif
+
+#include "monitor.h"
+#include "net.h"
+
+
+/**
+ *  Benchmark of the port connection tests. A number of TCP ports on the
+ *  loopback interface is connected one after another, the way a cycle
+ *  without the parallel connects does it, and then at once by
+ *  probe_ports(). Most ports accept the connection immediately,
+ *  some never answer and run into their timeout, like a firewalled or
+ *  hung service. The parallel run should take about as long as the
+ *  slowest port, the sequential one about the sum of the timeouts.
+ *
+ *    make connbench
+ *    ./connbench -n 500 -s 5 -t 1
+ *
+ *  The ports which never answer are emulated by a listening socket
+ *  whose accept queue is full, the kernel then drops the connection
+ *  requests. The accepting socket needs a backlog for all ports (see
+ *  /proc/sys/net/core/somaxconn on Linux).
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+struct myrun Run;
+char *prog = "connbench";
+char icmpnames[19][STRLEN];
+
+
+/* -------------------------------------------------------------- Prototypes */
+
+
+static double get_time(void);
+static int    listen_socket(int, int *);
+static void   drain(int);
+static void   usage(void);
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+int main(int argc, char **argv) {
+  int      i;
+  int      s;
+  int      opt;
+  int      count = 500;
+  int      silent = 5;
+  int      timeout = 1;
+  int      errors;
+  int      open_port, silent_port;
+  int      open_fd, silent_fd;
+  double   t, slowest;
+  Port_T  *ports;
+  Probe_T *probes;
+
+  while ((opt = getopt(argc, argv, "n:s:t:h")) != -1) {
+    switch (opt) {
+      case 'n':
+        count = atoi(optarg);
+        break;
+      case 's':
+        silent = atoi(optarg);
+        break;
+      case 't':
+        timeout = atoi(optarg);
+        break;
+      default:
+        usage();
+    }
+  }
+  if (count <= 0 || silent < 0 || silent > count || timeout <= 0 || optind != argc)
+    usage();
+
+  if ((open_fd = listen_socket(count, &open_port)) < 0 || (silent_fd = listen_socket(0, &silent_port)) < 0)
+    return 1;
+  /* Fill the accept queue of the silent socket, further connects are not answered */
+  for (i = 0; i < 4; i++)
+    if ((s = socket(AF_INET, SOCK_STREAM, 0)) >= 0) {
+      struct sockaddr_in sin;
+
+      memset(&sin, 0, sizeof(sin));
+      sin.sin_family      = AF_INET;
+      sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      sin.sin_port        = htons(silent_port);
+      fcntl(s, F_SETFL, O_NONBLOCK);
+      connect(s, (struct sockaddr *)&sin, sizeof(sin));
+    }
+  usleep(100000);
+
+  ports  = xcalloc(sizeof(Port_T), count);
+  probes = xcalloc(sizeof(Probe_T), count);
+  for (i = 0; i < count; i++) {
+    NEW(ports[i]);
+    ports[i]->family   = AF_INET;
+    ports[i]->type     = SOCK_STREAM;
+    ports[i]->hostname = "127.0.0.1";
+    ports[i]->port     = i < count - silent ? open_port : silent_port;
+    ports[i]->timeout  = timeout;
+    NEW(probes[i]);
+    probes[i]->port    = ports[i];
+  }
+  printf("%d ports, %d of them not answering, timeout %d s\n", count, silent, timeout);
+
+  t = get_time();
+  for (i = 0, errors = 0; i < count; i++) {
+    if ((s = create_generic_socket(ports[i])) < 0)
+      errors++;
+    else
+      close_socket(s);
+  }
+  printf("sequential connects  %9.3f s, %d failed\n", get_time() - t, errors);
+  drain(open_fd);
+
+  t = get_time();
+  if (! probe_ports(probes, count)) {
+    printf("parallel connects are not supported on this platform\n");
+    return 0;
+  }
+  t = get_time() - t;
+  for (i = 0, errors = 0, slowest = 0; i < count; i++) {
+    if (probes[i]->failed)
+      errors++;
+    else if (probes[i]->response > slowest)
+      slowest = probes[i]->response;
+  }
+  printf("parallel connects    %9.3f s, %d failed, slowest connected port %.3f s\n", t, errors, slowest);
+  drain(open_fd);
+
+  return 0;
+}
+
+
+void LogError(const char *s, ...) {
+  va_list ap;
+
+  va_start(ap, s);
+  vfprintf(stderr, s, ap);
+  va_end(ap);
+}
+
+
+void LogCritical(const char *s, ...) {
+  va_list ap;
+
+  va_start(ap, s);
+  vfprintf(stderr, s, ap);
+  va_end(ap);
+}
+
+
+void LogDebug(const char *s, ...) {
+  va_list ap;
+
+  va_start(ap, s);
+  vfprintf(stderr, s, ap);
+  va_end(ap);
+}
+
+
+void set_signal_block(sigset_t *new, sigset_t *old) {
+  sigfillset(new);
+  pthread_sigmask(SIG_BLOCK, new, old);
+}
+
+
+void *xcalloc(long count, long nbytes) {
+  void *p;
+
+  if (! (p = calloc(count, nbytes)))
+    abort();
+  return p;
+}
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+/**
+ * Get the monotonic time
+ * @return the time [s]
+ */
+static double get_time() {
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1000000000.;
+}
+
+
+/**
+ * Create a listening socket on a free loopback port
+ * @param backlog The accept queue length
+ * @param port The port number
+ * @return The socket or -1 if failed
+ */
+static int listen_socket(int backlog, int *port) {
+  int                s;
+  socklen_t          len = sizeof(struct sockaddr_in);
+  struct sockaddr_in sin;
+
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family      = AF_INET;
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if ((s = socket(AF_INET, SOCK_STREAM, 0)) < 0 || bind(s, (struct sockaddr *)&sin, sizeof(sin)) < 0 || listen(s, backlog) < 0 || getsockname(s, (struct sockaddr *)&sin, &len) < 0) {
+    fprintf(stderr, "%s: cannot create the listening socket -- %s\n", prog, STRERROR);
+    return -1;
+  }
+  fcntl(s, F_SETFL, O_NONBLOCK);
+  *port = ntohs(sin.sin_port);
+  return s;
+}
+
+
+/**
+ * Accept and close the queued connections
+ */
+static void drain(int s) {
+  int c;
+
+  while ((c = accept(s, NULL, NULL)) >= 0)
+    close(c);
+}
+
+
+static void usage() {
+  fprintf(stderr,
+    "Usage: connbench [-n ports] [-s silent] [-t timeout]\n"
+    "  -n ports    number of ports to connect (default 500)\n"
+    "  -s silent   number of ports which never answer (default 5)\n"
+    "  -t timeout  connect timeout [s] (default 1)\n");
+  exit(1);
+}
@@ -0,0 +1,359 @@
+/*
+ * Copyright (C) 2011 Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+
+#include <config.h>
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_STDARG_H
+#include <stdarg.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_SIGNAL_H
+#include <signal.h>
+#endif
+
+#ifdef TIME_WITH_SYS_TIME
+#include <time.h>
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#else
+#include <time.h>
+#endif
+
+#include "monitor.h"
+#include "process.h"
+#include "process_sysdep.h"
+
+
+/**
+ *  Benchmark of the process engine. It runs initprocesstree() for a
+ *  number of cycles and reports the scan time and the allocations done
+ *  through the monit allocator in every cycle. Point it to a synthetic
+ *  proc tree written by contrib/mkproctree, for example:
+ *
+ *    contrib/mkproctree -n 100000 /tmp/proc
+ *    make procbench
+ *    MONIT_PROCFS=/tmp/proc ./procbench -c 10
+ *
+ *  With -l the process lookup by pid, findprocess(), is timed for
+ *  every process of the table after the last cycle. With -a the tree
+ *  aggregation, fillprocesstree(), is timed alone on the last table.
+ *  The script contrib/procbench.sh runs the benchmark for several table
+ *  sizes and tree shapes.
+ *
+ *  The benchmark is linked with the process engine objects only, it
+ *  provides the few monit globals and the logging and allocation
+ *  functions the engine uses.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+struct myrun Run;
+char *prog = "procbench";
+SystemInfo_T systeminfo;
+Service_T servicelist = NULL;
+ProcessTree_T *ptree = NULL;
+int ptreesize = 0;
+
+static struct myservice system_service;
+
+/* The allocations done through the monit allocator */
+static struct myallocations {
+  long count;                                     /**< Number of allocations */
+  long bytes;                                       /**< Allocated bytes [B] */
+} allocations;
+
+
+/* -------------------------------------------------------------- Prototypes */
+
+
+static double get_time(void);
+static void   aggregate(int);
+static void   lookup(void);
+static void   usage(void);
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+int main(int argc, char **argv) {
+  int    opt;
+  int    i;
+  int    cycles = 5;
+  int    lookups = FALSE;
+  int    aggregates = FALSE;
+  int    size;
+  double t;
+  double min = 0, max = 0, sum = 0;
+
+  while ((opt = getopt(argc, argv, "ac:lt:vh")) != -1) {
+    switch (opt) {
+      case 'a':
+        aggregates = TRUE;
+        break;
+      case 'c':
+        cycles = atoi(optarg);
+        break;
+      case 'l':
+        lookups = TRUE;
+        break;
+      case 't':
+        Run.processthreads = atoi(optarg);
+        break;
+      case 'v':
+        Run.debug = TRUE;
+        break;
+      default:
+        usage();
+    }
+  }
+  if (cycles <= 0 || optind != argc)
+    usage();
+
+  system_service.name = "system";
+  Run.system          = &system_service;
+  Run.doprocessmatch  = TRUE;
+  if (! (Run.doprocess = init_process_info())) {
+    fprintf(stderr, "%s: cannot initialize the process engine\n", prog);
+    return 1;
+  }
+
+  printf("proc root %s, %d thread(s)\n", get_proc_root(), Run.processthreads > 0 ? Run.processthreads : 1);
+  for (i = 1; i <= cycles; i++) {
+    memset(&allocations, 0, sizeof(allocations));
+    t = get_time();
+    if ((size = initprocesstree(&ptree, &ptreesize)) <= 0) {
+      fprintf(stderr, "%s: cannot read the process table\n", prog);
+      return 1;
+    }
+    t = (get_time() - t) * 1000.;
+    printf("cycle %3d: %7d entries %10.3f ms %8ld allocations %10ld bytes\n", i, size, t, allocations.count, allocations.bytes);
+    if (i == 1 || t < min)
+      min = t;
+    if (i == 1 || t > max)
+      max = t;
+    sum += t;
+  }
+  printf("scan time min %.3f ms, avg %.3f ms, max %.3f ms\n", min, sum / cycles, max);
+  if (lookups)
+    lookup();
+  if (aggregates)
+    aggregate(cycles);
+
+  delprocesstree(&ptree, &ptreesize);
+  delprocessinfo();
+  return 0;
+}
+
+
+void LogError(const char *s, ...) {
+  va_list ap;
+
+  va_start(ap, s);
+  vfprintf(stderr, s, ap);
+  va_end(ap);
+}
+
+
+void LogCritical(const char *s, ...) {
+  va_list ap;
+
+  va_start(ap, s);
+  vfprintf(stderr, s, ap);
+  va_end(ap);
+}
+
+
+void LogInfo(const char *s, ...) {
+  va_list ap;
+
+  va_start(ap, s);
+  vfprintf(stderr, s, ap);
+  va_end(ap);
+}
+
+
+void LogDebug(const char *s, ...) {
+  va_list ap;
+
+  va_start(ap, s);
+  vfprintf(stderr, s, ap);
+  va_end(ap);
+}
+
+
+void *xmalloc(int n) {
+  void *p;
+
+  if (! (p = malloc(n)))
+    abort();
+  allocations.count++;
+  allocations.bytes += n;
+  return p;
+}
+
+
+void *xcalloc(long count, long nbytes) {
+  void *p;
+
+  if (! (p = calloc(count, nbytes)))
+    abort();
+  allocations.count++;
+  allocations.bytes += count * nbytes;
+  return p;
+}
+
+
+char *xstrdup(const char *s) {
+  char *p = xmalloc(strlen(s) + 1);
+
+  return strcpy(p, s);
+}
+
+
+void *xresize(void *p, long nbytes) {
+  if (! (p = realloc(p, nbytes)))
+    abort();
+  allocations.count++;
+  allocations.bytes += nbytes;
+  return p;
+}
+
+
+void set_signal_block(sigset_t *new, sigset_t *old) {
+  sigfillset(new);
+  pthread_sigmask(SIG_BLOCK, new, old);
+}
+
+
+void Schedule_notify() {
+}
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+/**
+ * Get the monotonic time
+ * @return the time [s]
+ */
+static double get_time() {
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1000000000.;
+}
+
+
+/**
+ * Aggregate the process tree sums of the last table again
+ * @param passes Number of aggregation passes
+ */
+static void aggregate(int passes) {
+  int                i, j;
+  int                root = -1;
+  double             t, sum = 0;
+  ProcessAggregate_T a;
+
+  for (i = 0; i < ptreesize && root < 0; i++)
+    if (ptree[i].pid >= 0 && ptree[i].pid == ptree[i].ppid)
+      root = i;
+  if (root < 0) {
+    fprintf(stderr, "%s: cannot find the root process\n", prog);
+    return;
+  }
+
+  memset(&a, 0, sizeof(a));
+  for (i = 0; i < passes; i++) {
+    for (j = 0; j < ptreesize; j++)
+      ptree[j].visited = 0;
+    memset(&allocations, 0, sizeof(allocations));
+    t = get_time();
+    fillprocesstree(ptree, root, ptreesize, &a);
+    sum += get_time() - t;
+  }
+  printf("aggregation of %d entries avg %.3f ms, root children sum %d, last pass %ld allocations\n", ptreesize, sum * 1000. / passes, ptree[root].children_sum, allocations.count);
+  freeprocessaggregate(&a);
+}
+
+
+/**
+ * Look up every process of the table by its pid
+ */
+static void lookup() {
+  int    i;
+  int    n = 0;
+  int    missed = 0;
+  double t = get_time();
+
+  for (i = 0; i < ptreesize; i++) {
+    if (ptree[i].pid < 0)
+      continue;
+    if (findprocess(ptree[i].pid, ptree, ptreesize) != i)
+      missed++;
+    n++;
+  }
+  t = get_time() - t;
+  printf("lookup of %d pids %.3f ms, %.1f ns per lookup%s\n", n, t * 1000., n ? t * 1000000000. / n : 0., missed ? ", LOOKUP ERRORS" : "");
+}
+
+
+static void usage() {
+  fprintf(stderr,
+    "Usage: procbench [-a] [-c cycles] [-l] [-t threads] [-v]\n"
+    "  -a          time the process tree aggregation alone\n"
+    "  -c cycles   number of process table scans (default 5)\n"
+    "  -l          time the lookup of every process by pid\n"
+    "  -t threads  number of the process table scan threads (default 1)\n"
+    "  -v          verbose, print the process engine debug messages\n"
+    "The proc root is taken from the MONIT_PROCFS environment variable.\n");
+  exit(1);
+}
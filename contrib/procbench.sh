@@ -0,0 +1,73 @@
+#!/bin/sh
+#
+# Run the process engine benchmark against synthetic proc trees created
+# by contrib/mkproctree. Build the benchmark with "make procbench" in the
+# top directory first, then run for example:
+#
+#   contrib/procbench.sh sizes
+#
+# Modes:
+#   sizes   1000, 10000 and 100000 processes, the scan and the lookup
+#           by pid must grow linearly with the number of processes
+#   shapes  100000 processes in a wide tree (all children of init) and
+#           in a deep one (a single chain), the aggregation must not
+#           depend on the tree shape
+#   threads 100000 processes read by 1, 2, 4 and 8 scan threads (or by
+#           the numbers of threads listed in $THREADS), the scan time
+#           should drop with the threads up to the number of CPUs
+#
+# The trees are written to $PROCBENCH_DIR (default /tmp/procbench) and
+# kept for the next run. To compare two monit versions, run the script
+# with the procbench binary of each one, PROCBENCH names the binary.
+
+DIR=${PROCBENCH_DIR:-/tmp/procbench}
+BENCH=${PROCBENCH:-./procbench}
+CONTRIB=`dirname $0`
+CYCLES=${CYCLES:-5}
+
+usage() {
+  echo "Usage: $0 sizes|shapes|threads" >&2
+  exit 1
+}
+
+# tree name processes depth fanout
+tree() {
+  if [ ! -f $DIR/$1/stat ]; then
+    $CONTRIB/mkproctree -n $2 -d $3 -f $4 $DIR/$1 > /dev/null || exit 1
+  fi
+}
+
+# run name [procbench options]
+run() {
+  name=$1
+  shift
+  echo "== $name"
+  MONIT_PROCFS=$DIR/$name $BENCH -c $CYCLES "$@" || exit 1
+}
+
+[ -x $BENCH ] || { echo "$0: $BENCH not found, run make procbench first" >&2; exit 1; }
+[ $# -eq 1 ] || usage
+
+case $1 in
+  sizes)
+    for n in 1000 10000 100000; do
+      tree n$n $n 8 16
+      run n$n -l
+    done
+    ;;
+  shapes)
+    tree wide 100000 1 100000
+    run wide -a
+    tree deep 100000 100000 1
+    run deep -a
+    ;;
+  threads)
+    tree n100000 100000 8 16
+    for t in ${THREADS:-1 2 4 8}; do
+      run n100000 -t $t
+    done
+    ;;
+  *)
+    usage
+    ;;
+esac
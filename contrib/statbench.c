@@ -0,0 +1,354 @@
+/*
+ * Copyright (C) 2011 Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+
+/**
+ *  Micro-benchmark of the Linux /proc/<pid>/stat parser. Recorded stat
+ *  lines are fed through the sscanf() based parser of monit 5.2.5 and
+ *  through the current single-pass parser, parse_proc_stat(), and the
+ *  cost per process is reported. The old parser is measured with and
+ *  without the /proc/uptime read it did for every process to compute
+ *  the start time. Both parsers must return the same items, lines they
+ *  disagree on are counted.
+ *
+ *  The lines are read from the given file, one stat line per line, for
+ *  example recorded by "for p in /proc/[0-9]*; do cat $p/stat; done".
+ *  Without a file they are recorded from the proc root at startup.
+ *  Build and run:
+ *
+ *    make statbench
+ *    ./statbench -n 100 stat.txt
+ *
+ *  The Linux sysdep source is included, so the benchmark measures the
+ *  static parser of the monit build. It is linked with the common
+ *  process engine object only.
+ *
+ *  @file
+ */
+
+
+#include "process/sysdep_LINUX.c"
+
+#ifdef HAVE_DIRENT_H
+#include <dirent.h>
+#endif
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define STAT_LINES_MAX 1000000
+
+struct myrun Run;
+char *prog = "statbench";
+SystemInfo_T systeminfo;
+
+static char **lines = NULL;
+static int    count = 0;
+
+
+/* -------------------------------------------------------------- Prototypes */
+
+
+static double get_time(void);
+static int    parse_stat_sscanf(char *, ProcStat_T *);
+static time_t get_starttime_uptime(void);
+static void   add_line(const char *);
+static int    record_file(const char *);
+static int    record_proc(void);
+static void   usage(void);
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+int main(int argc, char **argv) {
+  int         i, j;
+  int         opt;
+  int         passes = 10;
+  int         failed = 0;
+  int         differ = 0;
+  char        buf[1024];
+  double      t;
+  double      old_parse, old_total, new_parse;
+  ProcStat_T  a, b;
+
+  while ((opt = getopt(argc, argv, "n:h")) != -1) {
+    switch (opt) {
+      case 'n':
+        passes = atoi(optarg);
+        break;
+      default:
+        usage();
+    }
+  }
+  if (passes <= 0 || argc - optind > 1)
+    usage();
+  if (! (optind < argc ? record_file(argv[optind]) : record_proc()) || ! count) {
+    fprintf(stderr, "%s: no stat lines recorded\n", prog);
+    return 1;
+  }
+
+  /* Both parsers must agree, the old one can't parse all names => only the lines it accepts are compared */
+  for (i = 0; i < count; i++) {
+    snprintf(buf, sizeof(buf), "%s", lines[i]);
+    if (! parse_proc_stat(buf, &a)) {
+      failed++;
+      continue;
+    }
+    snprintf(buf, sizeof(buf), "%s", lines[i]);
+    if (parse_stat_sscanf(buf, &b) && (a.state != b.state || a.ppid != b.ppid || a.utime != b.utime || a.stime != b.stime || a.starttime != b.starttime || a.rss != b.rss))
+      differ++;
+  }
+
+  /* Every line is copied first, the old parser modifies the buffer */
+  t = get_time();
+  for (j = 0; j < passes; j++)
+    for (i = 0; i < count; i++) {
+      snprintf(buf, sizeof(buf), "%s", lines[i]);
+      parse_stat_sscanf(buf, &b);
+    }
+  old_parse = get_time() - t;
+
+  t = get_time();
+  for (j = 0; j < passes; j++)
+    for (i = 0; i < count; i++) {
+      snprintf(buf, sizeof(buf), "%s", lines[i]);
+      if (parse_stat_sscanf(buf, &b))
+        b.starttime += get_starttime_uptime();
+    }
+  old_total = get_time() - t;
+
+  t = get_time();
+  for (j = 0; j < passes; j++)
+    for (i = 0; i < count; i++) {
+      snprintf(buf, sizeof(buf), "%s", lines[i]);
+      parse_proc_stat(buf, &a);
+    }
+  new_parse = get_time() - t;
+
+  printf("%d stat lines, %d passes, %d rejected by the new parser, %d differing\n", count, passes, failed, differ);
+  printf("old sscanf parser          %8.1f ns per process\n", old_parse * 1000000000. / (passes * count));
+  printf("old parser + uptime read   %8.1f ns per process\n", old_total * 1000000000. / (passes * count));
+  printf("new single-pass parser     %8.1f ns per process\n", new_parse * 1000000000. / (passes * count));
+
+  return differ ? 1 : 0;
+}
+
+
+void LogError(const char *s, ...) {
+  va_list ap;
+
+  va_start(ap, s);
+  vfprintf(stderr, s, ap);
+  va_end(ap);
+}
+
+
+void LogCritical(const char *s, ...) {
+  va_list ap;
+
+  va_start(ap, s);
+  vfprintf(stderr, s, ap);
+  va_end(ap);
+}
+
+
+void LogDebug(const char *s, ...) {
+  va_list ap;
+
+  va_start(ap, s);
+  vfprintf(stderr, s, ap);
+  va_end(ap);
+}
+
+
+void *xcalloc(long count, long nbytes) {
+  void *p;
+
+  if (! (p = calloc(count, nbytes)))
+    abort();
+  return p;
+}
+
+
+char *xstrdup(const char *s) {
+  char *p;
+
+  if (! (p = strdup(s)))
+    abort();
+  return p;
+}
+
+
+void *xresize(void *p, long nbytes) {
+  if (! (p = realloc(p, nbytes)))
+    abort();
+  return p;
+}
+
+
+void set_signal_block(sigset_t *new, sigset_t *old) {
+  sigfillset(new);
+  pthread_sigmask(SIG_BLOCK, new, old);
+}
+
+
+int hasprocesscmdline(int pid, time_t starttime) {
+  return FALSE;
+}
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+/**
+ * Get the monotonic time
+ * @return the time [s]
+ */
+static double get_time() {
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1000000000.;
+}
+
+
+/**
+ * The /proc/<pid>/stat parser of monit 5.2.5
+ * @param buf the /proc/<pid>/stat content, it is modified
+ * @param stat the parsed items
+ * @return TRUE if succeeded otherwise FALSE
+ */
+static int parse_stat_sscanf(char *buf, ProcStat_T *stat) {
+  char *tmp;
+  long  cutime, cstime;
+
+  if (! (tmp = strrchr(buf, ')')))
+    return FALSE;
+  *tmp = 0;
+  if (sscanf(buf, "%*d (%255s", stat->name) != 1)
+    return FALSE;
+
+  tmp += 2;
+
+  if (sscanf(tmp,
+       "%c %d %*d %*d %*d %*d %*u %*u"
+       "%*u %*u %*u %lu %lu %ld %ld %*d %*d %*d "
+       "%*u %llu %*u %ld %*u %*u %*u %*u %*u "
+       "%*u %*u %*u %*u %*u %*u %*u %*u %*d %*d\n",
+       &stat->state,
+       &stat->ppid,
+       &stat->utime,
+       &stat->stime,
+       &cutime,
+       &cstime,
+       &stat->starttime,
+       &stat->rss) != 8)
+    return FALSE;
+  return TRUE;
+}
+
+
+/**
+ * The system start time of monit 5.2.5, read from /proc/uptime for
+ * every process
+ * @return seconds since unix epoch
+ */
+static time_t get_starttime_uptime() {
+  char   buf[1024];
+  double up = 0;
+
+  if (! read_proc_file(buf, 1024, "uptime", -1, NULL) || sscanf(buf, "%lf", &up) != 1)
+    return 0;
+  return time(NULL) - (time_t)up;
+}
+
+
+/**
+ * Add the stat line to the recorded lines
+ */
+static void add_line(const char *line) {
+  if (count >= STAT_LINES_MAX)
+    return;
+  if (! (count & (count - 1)))
+    lines = xresize(lines, (count ? 2 * count : 1) * sizeof(char *));
+  lines[count++] = xstrdup(line);
+}
+
+
+/**
+ * Record the stat lines from the file
+ * @param file The file with one stat line per line
+ * @return TRUE if succeeded otherwise FALSE
+ */
+static int record_file(const char *file) {
+  char  buf[1024];
+  FILE *f;
+
+  if (! (f = fopen(file, "r"))) {
+    fprintf(stderr, "%s: cannot open %s -- %s\n", prog, file, STRERROR);
+    return FALSE;
+  }
+  while (fgets(buf, sizeof(buf), f))
+    add_line(buf);
+  fclose(f);
+  return TRUE;
+}
+
+
+/**
+ * Record the stat lines of all processes in the proc root
+ * @return TRUE if succeeded otherwise FALSE
+ */
+static int record_proc() {
+  char           buf[1024];
+  DIR           *dir;
+  struct dirent *de;
+
+  if (! (dir = opendir(get_proc_root()))) {
+    fprintf(stderr, "%s: cannot open %s -- %s\n", prog, get_proc_root(), STRERROR);
+    return FALSE;
+  }
+  while ((de = readdir(dir)))
+    if (isdigit((int)*de->d_name) && read_proc_file(buf, sizeof(buf), "stat", atoi(de->d_name), NULL))
+      add_line(buf);
+  closedir(dir);
+  return TRUE;
+}
+
+
+static void usage() {
+  fprintf(stderr,
+    "Usage: statbench [-n passes] [file]\n"
+    "  -n passes  number of passes over the stat lines (default 10)\n"
+    "  file       recorded stat lines, one per line (default: read the\n"
+    "             stat files in the proc root, see MONIT_PROCFS)\n");
+  exit(1);
+}
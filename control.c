@@ -57,10 +57,15 @@
 #include <unistd.h>
 #endif
 
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
 #include "monitor.h"
 #include "net.h"
 #include "socket.h"
 #include "event.h"
+#include "process.h"
 
 
 /**
@@ -74,6 +79,13 @@
  */
 
 
+/* ------------------------------------------------------------- Definitions */
+
+/* The process start/stop polling interval bounds [ms] */
+#define WAIT_INTERVAL_MIN    5
+#define WAIT_INTERVAL_MAX 1000
+
+
 /* -------------------------------------------------------------- Prototypes */
 
 
@@ -83,6 +95,7 @@ static void do_monitor(Service_T);
 static void do_unmonitor(Service_T);
 static void wait_start(Service_T);
 static int  wait_stop(Service_T);
+static int  is_running(Service_T, time_t *);
 static void do_depend(Service_T, int);
 
 
@@ -460,15 +473,20 @@ static void do_depend(Service_T s, int action) {
  */
 static void wait_start(Service_T s) {
   int            isrunning = FALSE;
+  int            interval = WAIT_INTERVAL_MIN;
+  time_t         refreshed = 0;
   time_t         timeout = time(NULL) + s->start->timeout;
   
   ASSERT(s);
 
   while ((time(NULL) < timeout) && !Run.stopped) {
-    if ((isrunning = Util_isProcessRunning(s, TRUE)))
+    if ((isrunning = is_running(s, &refreshed)) > 0)
       break;
-    sleep(1);
+    poll(NULL, 0, interval);
+    interval = (2 * interval > WAIT_INTERVAL_MAX) ? WAIT_INTERVAL_MAX : 2 * interval;
   }
+  if (isrunning < 0)
+    isrunning = Util_isProcessRunning(s, TRUE);
   
   if (! isrunning)
     Event_post(s, Event_Exec, STATE_FAILED, s->action_EXEC, "failed to start");
@@ -488,15 +506,28 @@ static void wait_start(Service_T s) {
  */
 static int wait_stop(Service_T s) {
   int            isrunning = TRUE;
+  int            interval = WAIT_INTERVAL_MIN;
+  time_t         refreshed = 0;
   time_t         timeout = time(NULL) + s->stop->timeout;
   
   ASSERT(s);
 
   while ((time(NULL) < timeout) && !Run.stopped) {
-    if (! (isrunning = Util_isProcessRunning(s, TRUE)))
+    if (! (isrunning = is_running(s, &refreshed)))
       break;
-    sleep(1);
+    if (isrunning > 0) {
+      /* Wait for the exit of the process found, only then look for the service process again */
+      while (! waitprocessexit(isrunning, interval) && (time(NULL) < timeout) && !Run.stopped)
+        interval = (2 * interval > WAIT_INTERVAL_MAX) ? WAIT_INTERVAL_MAX : 2 * interval;
+      /* The exited process may still exist as a zombie */
+      if (getpgid(isrunning) == -1)
+        continue;
+    }
+    poll(NULL, 0, interval);
+    interval = (2 * interval > WAIT_INTERVAL_MAX) ? WAIT_INTERVAL_MAX : 2 * interval;
   }
+  if (isrunning < 0)
+    isrunning = Util_isProcessRunning(s, TRUE);
 
   if (isrunning) {
     Event_post(s, Event_Exec, STATE_FAILED, s->action_EXEC, "failed to stop");
@@ -508,3 +539,32 @@ static int wait_stop(Service_T s) {
   return TRUE;
 }
 
+
+/*
+ * Test if the service process is running. The pid file is just read
+ * again. For the service using "matching" the process matched before
+ * is tested first, the process tree is updated when it exited. While
+ * no process is matched, the process tree is updated to look for a
+ * new one at most once a second, so the short polling intervals don't
+ * read the whole process table again and again.
+ * @param s A Service to test
+ * @param refreshed The time of the last process tree update
+ * @return The process pid if running, 0 if not running or -1 if not
+ * known until the next process tree update
+ */
+static int is_running(Service_T s, time_t *refreshed) {
+  int    pid;
+  time_t now = time(NULL);
+
+  if (! s->matchlist)
+    return Util_isProcessRunning(s, FALSE);
+  if (s->matchpid) {
+    if ((pid = Util_isProcessRunning(s, FALSE)))
+      return pid;
+  } else if (now == *refreshed) {
+    return -1;
+  }
+  *refreshed = now;
+  return Util_isProcessRunning(s, TRUE);
+}
+
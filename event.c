@@ -58,14 +58,11 @@
 #include <unistd.h>
 #endif
 
-#ifdef HAVE_DIRENT_H
-#include <dirent.h>
-#endif
-
 #include "monitor.h"
 #include "alert.h"
 #include "event.h"
 #include "process.h"
+#include "queue.h"
 
 
 /**
@@ -109,10 +106,14 @@ EventTable_T Event_Table[]= {
 /* -------------------------------------------------------------- Prototypes */
 
 
+static unsigned int hash_event(EventAction_T, long);
+static Event_T find_event(Service_T, EventAction_T, long);
+static void add_event(Service_T, Event_T);
+static int  is_handled(Event_T);
 static void handle_event(Event_T);
 static void handle_action(Event_T, Action_T);
 static void Event_queue_add(Event_T);
-static void Event_queue_update(Event_T, const char *);
+static int  handle_queued(Event_T);
 
 
 /* ------------------------------------------------------------------ Public */
@@ -124,7 +125,9 @@ static void Event_queue_update(Event_T, const char *);
  * @param id The event identification
  * @param state The event state
  * @param action Description of the event action
- * @param s Optional message describing the event
+ * @param s Optional message describing the event, the printf-style
+ * message is formatted only if the event is handled (logged, alerted,
+ * queued or shown as the failed service status)
  */
 void Event_post(Service_T service, long id, short state, EventAction_T action, char *s, ...) {
   Event_T e;
@@ -133,93 +136,37 @@ void Event_post(Service_T service, long id, short state, EventAction_T action, c
   ASSERT(action);
   ASSERT(state == STATE_FAILED || state == STATE_SUCCEEDED || state == STATE_CHANGED || state == STATE_CHANGEDNOT);
 
-  if ((e = service->eventlist) == NULL) {
+  /* Each service and each test have its own custom actions object, so
+   * we share actions object address to identify event source. */
+  if ((e = find_event(service, action, id))) {
+    gettimeofday(&e->collected, NULL);
+
+    /* Shift the existing event flags to the left
+     * and set the first bit based on actual state */
+    e->state_map <<= 1;
+    e->state_map |= ((state == STATE_SUCCEEDED || state == STATE_CHANGEDNOT) ? 0 : 1);
+  } else {
     /* Only first failed/changed event can initialize the queue for given event type,
      * thus succeeded events are ignored until first error. */
     if (state == STATE_SUCCEEDED || state == STATE_CHANGEDNOT)
       return;
 
-    /* Initialize event list and add first event. The manadatory informations
-     * are cloned so the event is as standalone as possible and may be saved
-     * to the queue without the dependency on the original service, thus
-     * persistent and managable across monit restarts */
+    /* Event was not found in the pending events list, we will add it.
+     * The manadatory informations are cloned so the event is as standalone
+     * as possible and may be saved to the queue without the dependency on
+     * the original service, thus persistent and managable across monit
+     * restarts */
     NEW(e);
     e->id = id;
     gettimeofday(&e->collected, NULL);
     e->source = xstrdup(service->name);
+    e->service = service;
     e->mode = service->mode;
     e->type = service->type;
     e->state = STATE_INIT;
     e->state_map = 1;
     e->action = action;
-    if (s) {
-      long l;
-      va_list ap;
-
-      va_start(ap, s);
-      e->message = Util_formatString(s, ap, &l);
-      va_end(ap);
-    }
-    service->eventlist = e;
-  } else {
-    /* Try to find the event with the same origin and type identification.
-     * Each service and each test have its own custom actions object, so
-     * we share actions object address to identify event source. */
-    do {
-      if (e->action == action && e->id == id) {
-        gettimeofday(&e->collected, NULL);
-
-        /* Shift the existing event flags to the left
-         * and set the first bit based on actual state */
-        e->state_map <<= 1;
-        e->state_map |= ((state == STATE_SUCCEEDED || state == STATE_CHANGEDNOT) ? 0 : 1);
-
-        /* Update the message */
-        if (s) {
-          long l;
-          va_list ap;
-
-          FREE(e->message);
-          va_start(ap, s);
-          e->message = Util_formatString(s, ap, &l);
-          va_end(ap);
-        }
-	break;
-      }
-      e = e->next;
-    } while (e);
-
-    if (!e) {
-      /* Only first failed/changed event can initialize the queue for given event type,
-       * thus succeeded events are ignored until first error. */
-      if (state == STATE_SUCCEEDED || state == STATE_CHANGEDNOT)
-        return;
-
-      /* Event was not found in the pending events list, we will add it.
-       * The manadatory informations are cloned so the event is as standalone
-       * as possible and may be saved to the queue without the dependency on
-       * the original service, thus persistent and managable across monit
-       * restarts */
-      NEW(e);
-      e->id = id;
-      gettimeofday(&e->collected, NULL);
-      e->source = xstrdup(service->name);
-      e->mode = service->mode;
-      e->type = service->type;
-      e->state = STATE_INIT;
-      e->state_map = 1;
-      e->action = action;
-      if (s) {
-        long l;
-        va_list ap;
-
-        va_start(ap, s);
-        e->message = Util_formatString(s, ap, &l);
-        va_end(ap);
-      }
-      e->next = service->eventlist;
-      service->eventlist = e;
-    }
+    add_event(service, e);
   }
 
   e->state_changed = Event_check_state(e, state);
@@ -231,10 +178,41 @@ void Event_post(Service_T service, long id, short state, EventAction_T action, c
   } else
     e->count++;
 
+  /* The message is formatted only if the event will be handled, the
+   * recurrent succeeded events keep the message of the last handled
+   * event and don't allocate anything */
+  if (! is_handled(e))
+    return;
+  if (s) {
+    long l;
+    va_list ap;
+
+    FREE(e->message);
+    va_start(ap, s);
+    e->message = Util_formatString(s, ap, &l);
+    va_end(ap);
+  }
+
   handle_event(e);
 }
 
 
+/**
+ * Release the pending events of the service and their index
+ * @param service The Service the events belong to
+ */
+void Event_clear(Service_T service) {
+
+  ASSERT(service);
+
+  if (service->eventlist)
+    gc_event(&service->eventlist);
+  FREE(service->eventtable);
+  service->eventtablesize = 0;
+  service->eventcount = 0;
+}
+
+
 /* -------------------------------------------------------------- Properties */
 
 
@@ -248,6 +226,10 @@ Service_T Event_get_source(Event_T E) {
 
   ASSERT(E);
 
+  /* The events read from the queue have no direct service reference */
+  if (E->service)
+    return E->service;
+
   if (!(s = Util_getService(E->source)))
     LogError("Service %s not found in monit configuration\n", E->source);
 
@@ -455,162 +437,97 @@ const char *Event_get_action_description(Event_T E) {
  * Reprocess the partially handled event queue
  */
 void Event_queue_process() {
-  DIR           *dir = NULL;
-  FILE          *file = NULL;
-  struct dirent *de = NULL;
-  EventAction_T  ea = NULL;
-  Action_T       a = NULL;
 
   /* return in the case that the eventqueue is not enabled or empty */
   if (! Run.eventlist_dir || (! Run.handler_init && ! Run.handler_queue[HANDLER_ALERT] && ! Run.handler_queue[HANDLER_MMONIT]))
     return;
 
-  if (! (dir = opendir(Run.eventlist_dir)) ) {
-    if (errno != ENOENT)
-      LogError("%s: cannot open the directory %s -- %s\n", prog, Run.eventlist_dir, STRERROR);
-    return;
-  }
+  Queue_replay(handle_queued);
+  Run.handler_init = FALSE;
+}
 
-  if ((de = readdir(dir)))
-    DEBUG("Processing postponed events queue\n");
-
-  NEW(ea);
-  NEW(a);
-
-  while (de) {
-    int            size;
-    int            handlers_passed = 0;
-    int           *version = NULL;
-    short         *action = NULL;
-    Event_T        e = NULL;
-    struct stat    st;
-    char           file_name[STRLEN];
-
-    /* In the case that all handlers failed, skip the further processing in
-     * this cycle. Alert handler is currently defined anytime (either
-     * explicitly or localhost by default) */
-    if ( (Run.mmonits && FLAG(Run.handler_flag, HANDLER_MMONIT) && FLAG(Run.handler_flag, HANDLER_ALERT)) || FLAG(Run.handler_flag, HANDLER_ALERT))
-      break;
 
-    snprintf(file_name, STRLEN, "%s/%s", Run.eventlist_dir, de->d_name);
+/* ----------------------------------------------------------------- Private */
 
-    if (!stat(file_name, &st) && S_ISREG(st.st_mode)) {
-      DEBUG("%s: processing queued event %s\n", prog, file_name);
 
-      if (! (file = fopen(file_name, "r")) ) {
-        LogError("%s: queued event processing failed - cannot open the file %s -- %s\n", prog, file_name, STRERROR);
-        goto error1;
-      }
+/*
+ * Hash the event source identification
+ * @param action The event action object of the test
+ * @param id The event identification
+ * @return The hash value
+ */
+static unsigned int hash_event(EventAction_T action, long id) {
+  unsigned int h = (unsigned int)(((unsigned long)action >> 3) ^ (unsigned long)id) * 2654435761U;
 
-      /* read event structure version */
-      if (!(version = File_readQueue(file, &size))) {
-        LogError("skipping queued event %s - unknown data format\n", file_name);
-        goto error2;
-      }
-      if (size != sizeof(int)) {
-        LogError("Aborting queued event %s - invalid size %d\n", file_name, size);
-        goto error3;
-      }
-      if (*version != EVENT_VERSION) {
-        LogError("Aborting queued event %s - incompatible data format version %d\n", file_name, *version);
-        goto error3;
-      }
+  return h ^ (h >> 16);
+}
 
-      /* read event structure */
-      if (!(e = File_readQueue(file, &size)))
-        goto error3;
-      if (size != sizeof(*e))
-        goto error4;
-
-      /* read source */
-      if (!(e->source = File_readQueue(file, &size)))
-        goto error4;
-
-      /* read message */
-      if (!(e->message = File_readQueue(file, &size)))
-        goto error5;
-
-      /* read event action */
-      if (!(action = File_readQueue(file, &size)))
-        goto error6;
-      if (size != sizeof(short))
-        goto error7;
-      a->id = *action;
-      if (e->state == STATE_FAILED)
-        ea->failed = a;
-      else
-        ea->succeeded = a;
-      e->action = ea;
-
-      /* Retry all remaining handlers */
-
-      /* alert */
-      if (e->flag & HANDLER_ALERT) {
-        if (Run.handler_init)
-          Run.handler_queue[HANDLER_ALERT]++;
-        if ((Run.handler_flag & HANDLER_ALERT) != HANDLER_ALERT) {
-          if ( handle_alert(e) != HANDLER_ALERT ) {
-            e->flag &= ~HANDLER_ALERT;
-            Run.handler_queue[HANDLER_ALERT]--;
-            handlers_passed++;
-          } else {
-            LogError("Alert handler failed, retry scheduled for next cycle\n");
-            Run.handler_flag |= HANDLER_ALERT;
-          }
-        }
-      }
 
-      /* mmonit */
-      if (e->flag & HANDLER_MMONIT) {
-        if (Run.handler_init)
-          Run.handler_queue[HANDLER_MMONIT]++;
-        if ((Run.handler_flag & HANDLER_MMONIT) != HANDLER_MMONIT) {
-          if ( handle_mmonit(e) != HANDLER_MMONIT ) {
-            e->flag &= ~HANDLER_MMONIT;
-            Run.handler_queue[HANDLER_MMONIT]--;
-            handlers_passed++;
-          } else {
-            LogError("M/Monit handler failed, retry scheduled for next cycle\n");
-            Run.handler_flag |= HANDLER_MMONIT;
-          }
-        }
-      }
+/*
+ * Find the pending event of the test in the service event index
+ * @param S The service
+ * @param action The event action object of the test
+ * @param id The event identification
+ * @return The event or NULL if there is no pending event
+ */
+static Event_T find_event(Service_T S, EventAction_T action, long id) {
+  unsigned int i;
+  unsigned int mask;
+  Event_T      e;
+
+  if (! S->eventtable)
+    return NULL;
+  mask = S->eventtablesize - 1;
+  for (i = hash_event(action, id) & mask; (e = S->eventtable[i]); i = (i + 1) & mask)
+    if (e->action == action && e->id == id)
+      return e;
+  return NULL;
+}
 
-      /* If no error persists, remove it from the queue */
-      if (e->flag == HANDLER_SUCCEEDED) {
-        DEBUG("Removing queued event %s\n", file_name);
-        if (unlink(file_name) < 0)
-          LogError("Failed to remove queued event file '%s' -- %s\n", file_name, STRERROR);
-      } else if (handlers_passed > 0) {
-        DEBUG("Updating queued event %s (some handlers passed)\n", file_name);
-        Event_queue_update(e, file_name);
-      }
 
-error7:
-      FREE(action);
-error6:
-      FREE(e->message);
-error5:
-      FREE(e->source);
-error4:
-      FREE(e);
-error3:
-      FREE(version);
-error2:
-      fclose(file);
+/*
+ * Add the event to the service event list and index. The list keeps
+ * the order of the status output, the index is grown to keep it at
+ * most half full and it is rebuilt from the list.
+ * @param S The service
+ * @param E The new event
+ */
+static void add_event(Service_T S, Event_T E) {
+  unsigned int i;
+  unsigned int mask;
+  Event_T      e;
+
+  if (2 * (S->eventcount + 1) > S->eventtablesize) {
+    FREE(S->eventtable);
+    S->eventtablesize = S->eventtablesize ? 2 * S->eventtablesize : 16;
+    S->eventtable = xcalloc(sizeof(Event_T), S->eventtablesize);
+    mask = S->eventtablesize - 1;
+    for (e = S->eventlist; e; e = e->next) {
+      for (i = hash_event(e->action, e->id) & mask; S->eventtable[i]; i = (i + 1) & mask)
+        ;
+      S->eventtable[i] = e;
     }
-error1:
-    de = readdir(dir);
   }
-  Run.handler_init = FALSE;
-  closedir(dir);
-  FREE(a);
-  FREE(ea);
-  return;
+  mask = S->eventtablesize - 1;
+  for (i = hash_event(E->action, E->id) & mask; S->eventtable[i]; i = (i + 1) & mask)
+    ;
+  S->eventtable[i] = E;
+  E->next = S->eventlist;
+  S->eventlist = E;
+  S->eventcount++;
 }
 
 
-/* ----------------------------------------------------------------- Private */
+/*
+ * We will handle only first succeeded event, recurrent succeeded events
+ * or insufficient succeeded events during failed service state are
+ * ignored. Failed events are handled each time.
+ * @param E An event
+ * @return TRUE if the event will be handled
+ */
+static int is_handled(Event_T E) {
+  return (E->state_changed || !(E->state == STATE_SUCCEEDED || E->state == STATE_CHANGEDNOT || ((E->state_map & 0x1) ^ 0x1)));
+}
 
 
 /*
@@ -625,12 +542,6 @@ static void handle_event(Event_T E) {
   ASSERT(E->action->failed);
   ASSERT(E->action->succeeded);
 
-  /* We will handle only first succeeded event, recurrent succeeded events
-   * or insufficient succeeded events during failed service state are
-   * ignored. Failed events are handled each time. */
-  if (!E->state_changed && (E->state == STATE_SUCCEEDED || E->state == STATE_CHANGEDNOT || ((E->state_map & 0x1) ^ 0x1)))
-    return;
-
   S = Event_get_source(E);
   if (!S) {
     LogError("Event handling aborted\n");
@@ -727,135 +638,80 @@ static void handle_action(Event_T E, Action_T A) {
  * @param E An event object
  */
 static void Event_queue_add(Event_T E) {
-  FILE        *file = NULL;
-  char         file_name[STRLEN];
-  int          version = EVENT_VERSION;
-  short        action = Event_get_action(E);
-  int          rv = FALSE;
-  mode_t       mask;
 
   ASSERT(E);
   ASSERT(E->flag != HANDLER_SUCCEEDED);
 
-  if (!File_checkQueueDirectory(Run.eventlist_dir, 0700)) {
-    LogError("%s: Aborting event - cannot access the directory %s\n", prog, Run.eventlist_dir);
-    return;
-  }
-    
-  if (!File_checkQueueLimit(Run.eventlist_dir, Run.eventlist_slots)) {
-    LogError("%s: Aborting event - queue over quota\n", prog);
-    return;
-  }
-    
-  /* compose the file name of actual timestamp and service name */
-  snprintf(file_name, STRLEN, "%s/%ld_%lx", Run.eventlist_dir, (long int)time(NULL), (long unsigned)E->source);
-
-  DEBUG("%s: Adding event to the queue file %s for later delivery\n", prog, file_name);
-
-  mask = umask(QUEUEMASK);
-  file = fopen(file_name, "w");
-  umask(mask);
-  if (! file) {
-    LogError("%s: Aborting event - cannot open the event file %s -- %s\n", prog, file_name, STRERROR);
-    return;
-  }
-
-  /* write event structure version */
-  if (!(rv = File_writeQueue(file, &version, sizeof(int))))
-    goto error;
-
-  /* write event structure */
-  if (!(rv = File_writeQueue(file, E, sizeof(*E))))
-    goto error;
-
-  /* write source */
-  if (!(rv = File_writeQueue(file, E->source, E->source ? strlen(E->source)+1 : 0)))
-    goto error;
-
-  /* write message */
-  if (!(rv = File_writeQueue(file, E->message, E->message ? strlen(E->message)+1 : 0)))
-    goto error;
+  DEBUG("%s: Adding event to the queue for later delivery\n", prog);
 
-  /* write event action */
-  if (!(rv = File_writeQueue(file, &action, sizeof(short))))
-    goto error;
-
-  error:
-  fclose(file);
-  if (!rv) {
-    LogError("%s: Aborting event - unable to save event information to %s\n",  prog, file_name);
-    if (unlink(file_name) < 0)
-      LogError("Failed to remove event file '%s' -- %s\n", file_name, STRERROR);
-  } else {
+  if (Queue_add(E)) {
     if (!Run.handler_init && E->flag & HANDLER_ALERT)
       Run.handler_queue[HANDLER_ALERT]++;
     if (!Run.handler_init && E->flag & HANDLER_MMONIT)
       Run.handler_queue[HANDLER_MMONIT]++;
   }
-
-  return;
 }
 
 
 /**
- * Update the partialy handled event in the global queue
- * @param E An event object
- * @param file_name File name
+ * Retry the failed handlers of the event read from the queue
+ * @param e An event object
+ * @return QUEUE_DONE if the event was delivered, QUEUE_UPDATE if some
+ * handlers passed, QUEUE_KEEP if none passed and QUEUE_STOP if all
+ * handlers failed in this cycle already
  */
-static void Event_queue_update(Event_T E, const char *file_name) {
-  FILE        *file = NULL;
-  int          version = EVENT_VERSION;
-  short        action = Event_get_action(E);
-  int          rv = FALSE;
-  mode_t       mask;
-
-  ASSERT(E);
-  ASSERT(E->flag != HANDLER_SUCCEEDED);
-
-  if (!File_checkQueueDirectory(Run.eventlist_dir, 0700)) {
-    LogError("%s: Aborting event - cannot access the directory %s\n", prog, Run.eventlist_dir);
-    return;
-  }
-    
-  DEBUG("%s: Updating event in the queue file %s for later delivery\n", prog, file_name);
-
-  mask = umask(QUEUEMASK);
-  file = fopen(file_name, "w");
-  umask(mask);
-  if (! file)
-  {
-    LogError("%s: Aborting event - cannot open the event file %s -- %s\n", prog, file_name, STRERROR);
-    return;
-  }
-
-  /* write event structure version */
-  if (!(rv = File_writeQueue(file, &version, sizeof(int))))
-    goto error;
+static int handle_queued(Event_T e) {
+  int handlers_passed = 0;
 
-  /* write event structure */
-  if (!(rv = File_writeQueue(file, E, sizeof(*E))))
-    goto error;
+  /* In the case that all handlers failed, skip the further processing in
+   * this cycle. Alert handler is currently defined anytime (either
+   * explicitly or localhost by default) */
+  if ( (Run.mmonits && FLAG(Run.handler_flag, HANDLER_MMONIT) && FLAG(Run.handler_flag, HANDLER_ALERT)) || FLAG(Run.handler_flag, HANDLER_ALERT))
+    return QUEUE_STOP;
 
-  /* write source */
-  if (!(rv = File_writeQueue(file, E->source, E->source ? strlen(E->source)+1 : 0)))
-    goto error;
+  DEBUG("%s: processing queued event of service %s\n", prog, e->source);
 
-  /* write message */
-  if (!(rv = File_writeQueue(file, E->message, E->message ? strlen(E->message)+1 : 0)))
-    goto error;
+  /* Retry all remaining handlers */
 
-  /* write event action */
-  if (!(rv = File_writeQueue(file, &action, sizeof(short))))
-    goto error;
+  /* alert */
+  if (e->flag & HANDLER_ALERT) {
+    if (Run.handler_init)
+      Run.handler_queue[HANDLER_ALERT]++;
+    if ((Run.handler_flag & HANDLER_ALERT) != HANDLER_ALERT) {
+      if ( handle_alert(e) != HANDLER_ALERT ) {
+        e->flag &= ~HANDLER_ALERT;
+        Run.handler_queue[HANDLER_ALERT]--;
+        handlers_passed++;
+      } else {
+        LogError("Alert handler failed, retry scheduled for next cycle\n");
+        Run.handler_flag |= HANDLER_ALERT;
+      }
+    }
+  }
 
-  error:
-  fclose(file);
-  if (!rv) {
-    LogError("%s: Aborting event - unable to update event information to %s\n",  prog, file_name);
-    if (unlink(file_name) < 0)
-      LogError("Failed to remove event file '%s' -- %s\n", file_name, STRERROR);
+  /* mmonit */
+  if (e->flag & HANDLER_MMONIT) {
+    if (Run.handler_init)
+      Run.handler_queue[HANDLER_MMONIT]++;
+    if ((Run.handler_flag & HANDLER_MMONIT) != HANDLER_MMONIT) {
+      if ( handle_mmonit(e) != HANDLER_MMONIT ) {
+        e->flag &= ~HANDLER_MMONIT;
+        Run.handler_queue[HANDLER_MMONIT]--;
+        handlers_passed++;
+      } else {
+        LogError("M/Monit handler failed, retry scheduled for next cycle\n");
+        Run.handler_flag |= HANDLER_MMONIT;
+      }
+    }
   }
 
-  return;
+  /* If no error persists, remove it from the queue */
+  if (e->flag == HANDLER_SUCCEEDED) {
+    DEBUG("Removing queued event\n");
+    return QUEUE_DONE;
+  } else if (handlers_passed > 0) {
+    DEBUG("Updating queued event (some handlers passed)\n");
+    return QUEUE_UPDATE;
+  }
+  return QUEUE_KEEP;
 }
-
@@ -94,11 +94,20 @@ extern EventTable_T Event_Table[];
  * @param id The event identification
  * @param state The event state
  * @param action Description of the event action
- * @param s Optional message describing the event
+ * @param s Optional message describing the event, the printf-style
+ * message is formatted only if the event is handled (logged, alerted,
+ * queued or shown as the failed service status)
  */
 void Event_post(Service_T service, long id, short state, EventAction_T action, char *s, ...);
 
 
+/**
+ * Release the pending events of the service and their index
+ * @param service The Service the events belong to
+ */
+void Event_clear(Service_T service);
+
+
 /**
  * Get the Service where the event orginated
  * @param E An event object
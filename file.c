@@ -405,109 +405,3 @@ int File_checkQueueDirectory(char *path, mode_t mode) {
   return TRUE;
 }
 
-
-/**
- * Check the queue size limit.
- * @param path The fully qualified path to the directory
- * @param limit The queue limit
- * @return TRUE if the succeeded otherwise FALSE
- */
-int File_checkQueueLimit(char *path, int limit) {
-  int            used = 0;
-  DIR           *dir = NULL;
-  struct dirent *de = NULL;
-
-  if(limit < 0)
-    return TRUE;
-
-  if(! (dir = opendir(path)) ) {
-    LogError("%s: cannot open the event queue directory %s -- %s\n", prog, path, STRERROR);
-    return FALSE;
-  }
-  while( (de = readdir(dir)) ) {
-    struct stat st;
-
-    if(!stat(de->d_name, &st) && S_ISREG(st.st_mode) && ++used > limit) {
-      LogError("%s: event queue full\n", prog);
-      closedir(dir);
-      return FALSE;
-    }
-  }
-  closedir(dir);
-  return TRUE;
-}
-
-
-/**
- * Write data to the queue file
- * @param file Filedescriptor to write to
- * @param data Data to be written
- * @param size Size of the data to be written
- * @return TRUE if the succeeded otherwise FALSE
- */
-int File_writeQueue(FILE *file, void *data, int size) {
-  int rv;
-
-  ASSERT(file);
-
-  /* write size */
-  if((rv = fwrite(&size, 1, sizeof(int), file)) != sizeof(int)) {
-    if (feof(file) || ferror(file))
-      LogError("%s: queued event file: unable to write event size -- %s\n", prog, feof(file) ? "end of file" : "stream error");
-    else
-      LogError("%s: queued event file: unable to write event size -- read returned %d bytes\n", prog, rv);
-    return FALSE;
-  }
-
-  /* write data if any */
-  if(size > 0) {
-    if((rv = fwrite(data, 1, size, file)) != size) {
-      if (feof(file) || ferror(file))
-        LogError("%s: queued event file: unable to write event size -- %s\n", prog, feof(file) ? "end of file" : "stream error");
-      else
-        LogError("%s: queued event file: unable to write event size -- read returned %d bytes\n", prog, rv);
-      return FALSE;
-    }
-  }
-
-  return TRUE;
-}
-
-
-/**
- * Read the data from the queue file's actual position
- * @param file Filedescriptor to read from
- * @param size Size of the data read
- * @return The data read if any or NULL. The size parameter is set
- * appropriately.
- */
-void *File_readQueue(FILE *file, int *size) {
-  int rv;
-  void *data = NULL;
-
-  ASSERT(file);
-
-  /* read size */
-  if((rv = fread(size, 1, sizeof(int), file)) != sizeof(int)) {
-    if (feof(file) || ferror(file))
-      LogError("%s: queued event file: unable to read event size -- %s\n", prog, feof(file) ? "end of file" : "stream error");
-    else
-      LogError("%s: queued event file: unable to read event size -- read returned %d bytes\n", prog, rv);
-    return NULL;
-  }
-
-  /* read data if any (allow 1MB at maximum to prevent enormous memory allocation) */
-  if(*size > 0 && *size < 1048576) {
-    data = xcalloc(1, *size);
-    if((rv = fread(data, 1, *size, file)) != *size) {
-      FREE(data);
-      if (feof(file) || ferror(file))
-        LogError("%s: queued event file: unable to read event data -- %s\n", prog, feof(file) ? "end of file" : "stream error");
-      else
-        LogError("%s: queued event file: unable to read event data -- read returned %d bytes\n", prog, rv);
-      return NULL;
-    }
-  }
-  return data;
-}
-
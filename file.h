@@ -140,33 +140,4 @@ int File_checkStat(char *filename, char *description, int permmask);
 int File_checkQueueDirectory(char *path, mode_t mode);
 
 
-/**
- * Check the queue size limit.
- * @param path The fully qualified path to the directory
- * @param mode The queue limit
- * @return TRUE if the succeeded otherwise FALSE
- */
-int File_checkQueueLimit(char *path, int limit);
-
-
-/**
- * Write data to the queue file
- * @param file Filedescriptor to write to
- * @param data Data to be written
- * @param size Size of the data to be written
- * @return TRUE if the succeeded otherwise FALSE
- */
-int File_writeQueue(FILE *file, void *data, int size);
-
-
-/**
- * Read the data from the queue file's actual position
- * @param file Filedescriptor to read from
- * @param size Size of the data read
- * @return The data read if any or NULL. The size parameter is set
- * appropriately.
- */
-void *File_readQueue(FILE *file, int *size);
-
-
 #endif
@@ -40,6 +40,8 @@
 #include "monitor.h"
 #include "protocol.h"
 #include "process.h"
+#include "event.h"
+#include "queue.h"
 #include "ssl.h"
 #include "engine.h"
 
@@ -93,12 +95,15 @@ void gc() {
   gc_protocols();
 
   if(Run.doprocess) {
-    delprocesstree(&oldptree, &oldptreesize);
     delprocesstree(&ptree, &ptreesize);
+    delprocessinfo();
   }
+
+  delprocessmatch();
   
   if(servicelist)
     _gc_service_list(&servicelist);
+  Util_resetServiceIndex();
   
   if(servicegrouplist)
     _gc_servicegroup(&servicegrouplist);
@@ -118,6 +123,7 @@ void gc() {
   if(Run.eventlist)
     gc_event(&Run.eventlist);
   
+  Queue_close();
   FREE(Run.eventlist_dir);
   FREE(Run.mygroup);
   FREE(Run.localhostname);
@@ -280,8 +286,20 @@ static void _gc_service(Service_T *s) {
   if((*s)->action_ACTION)
     _gc_eventaction(&(*s)->action_ACTION);
   
-  if((*s)->eventlist)
-    gc_event(&(*s)->eventlist);
+  Event_clear(*s);
+
+  if((*s)->cgroup) {
+    FREE((*s)->cgroup->path);
+    FREE((*s)->cgroup->current);
+    FREE((*s)->cgroup);
+  }
+
+  if((*s)->sample) {
+    int i;
+    for (i = 0; i < SAMPLE_METRICS; i++)
+      FREE((*s)->sample->ring[i]);
+    FREE((*s)->sample);
+  }
 
   FREE((*s)->name);
   FREE((*s)->path);
@@ -78,6 +78,8 @@
 #include "alert.h"
 #include "process.h"
 #include "device.h"
+#include "sampler.h"
+#include "schedule.h"
 
 #define ACTION(c) !strncasecmp(req->url, c, sizeof(c))
 
@@ -613,7 +615,7 @@ static void handle_action(HttpRequest req, HttpResponse res) {
     }
     LogInfo("%s service '%s' on user request\n", action, s->name);
     Run.doaction = TRUE; /* set the global flag */
-    do_wakeupcall();
+    Schedule_notify();
   }
   do_service(req, res, s);
 }
@@ -668,7 +670,7 @@ static void handle_do_action(HttpRequest req, HttpResponse res) {
     }
 
     Run.doaction = TRUE; 
-    do_wakeupcall();
+    Schedule_notify();
   }
 }
 
@@ -685,7 +687,8 @@ static void handle_run(HttpRequest req, HttpResponse res) {
     }
     if(IS(action, "validate")) {
       LogInfo("The Monit http server woke up on user request\n");
-      do_wakeupcall();
+      Run.dowakeup = TRUE;
+      Schedule_notify();
     } else if(IS(action, "stop")) {
       LogInfo("The Monit http server stopped on user request\n");
       send_error(res, SC_SERVICE_UNAVAILABLE,
@@ -796,9 +799,14 @@ static void do_service(HttpRequest req, HttpResponse res, Service_T s) {
     out_print(res, "then %s</td></tr>", Util_describeAction(s->action_NONEXIST->succeeded, buf, sizeof(buf)));
   }
 
-  out_print(res,
-    "<tr><td>Check service</td><td>every %d cycle</td></tr>",
-    s->every?s->every:1);
+  if(s->interval)
+    out_print(res,
+      "<tr><td>Check service</td><td>every %d ms</td></tr>",
+      s->interval);
+  else
+    out_print(res,
+      "<tr><td>Check service</td><td>every %d cycle</td></tr>",
+      s->every?s->every:1);
 
   for (ar = s->actionratelist; ar; ar = ar->next)
     out_print(res, "<tr><td>Timeout</td><td>If restarted %d times within %d cycle(s) then %s</td></tr>", ar->count, ar->cycle, Util_describeAction(ar->action->failed, buf, sizeof(buf)));
@@ -902,6 +910,9 @@ static void do_home_system(HttpRequest req, HttpResponse res) {
       "%.1f%%us,&nbsp;%.1f%%sy"
     #ifdef HAVE_CPU_WAIT
       ",&nbsp;%.1f%%wa"
+    #endif
+    #ifdef HAVE_CPU_STEAL
+      ",&nbsp;%.1f%%hi,&nbsp;%.1f%%st"
     #endif
       "</td>"
       "<td align=\"right\" width=\"20%%\">%.1f%% [%ld&nbsp;kB]</td>"
@@ -911,6 +922,10 @@ static void do_home_system(HttpRequest req, HttpResponse res) {
       systeminfo.total_cpu_syst_percent > 0 ? systeminfo.total_cpu_syst_percent/10. : 0,
     #ifdef HAVE_CPU_WAIT
       systeminfo.total_cpu_wait_percent > 0 ? systeminfo.total_cpu_wait_percent/10. : 0,
+    #endif
+    #ifdef HAVE_CPU_STEAL
+      systeminfo.total_cpu_irq_percent > 0 ? systeminfo.total_cpu_irq_percent/10. : 0,
+      systeminfo.total_cpu_steal_percent > 0 ? systeminfo.total_cpu_steal_percent/10. : 0,
     #endif
       systeminfo.total_mem_percent/10., systeminfo.total_mem_kbyte,
       systeminfo.total_swap_percent/10., systeminfo.total_swap_kbyte);
@@ -1744,6 +1759,14 @@ static void print_service_rules_resource(HttpResponse res, Service_T s) {
           out_print(res, "CPU wait limit");
           break;
           
+        case RESOURCE_ID_CPUSTEAL: 
+          out_print(res, "CPU steal limit");
+          break;
+          
+        case RESOURCE_ID_CPUCORE: 
+          out_print(res, "CPU core limit");
+          break;
+          
         case RESOURCE_ID_MEM_PERCENT: 
           out_print(res, "Memory usage limit");
           break;
@@ -1783,6 +1806,11 @@ static void print_service_rules_resource(HttpResponse res, Service_T s) {
         case RESOURCE_ID_TOTAL_MEM_PERCENT:
           out_print(res, "Memory usage limit (incl. children)");
           break;
+
+        default:
+          if (IS_RESOURCE_PRESSURE(q->resource_id))
+            out_print(res, "%s limit", pressurenames[q->resource_id - RESOURCE_ID_PRESSURE]);
+          break;
       }
       out_print(res, "</td><td>");
       switch (q->resource_id) {
@@ -1792,9 +1820,13 @@ static void print_service_rules_resource(HttpResponse res, Service_T s) {
         case RESOURCE_ID_CPUUSER:
         case RESOURCE_ID_CPUSYSTEM:
         case RESOURCE_ID_CPUWAIT:
+        case RESOURCE_ID_CPUSTEAL:
+        case RESOURCE_ID_CPUCORE:
         case RESOURCE_ID_MEM_PERCENT:
         case RESOURCE_ID_SWAP_PERCENT:
-          out_print(res, "If %s %.1f%% %s ", operatornames[q->operator], q->limit / 10., Util_getEventratio(a->failed, buf, sizeof(buf)));
+        default: /* pressure stall */
+          out_print(res, "If%s ", Sampler_describe(q, buf, sizeof(buf)));
+          out_print(res, "%s %.1f%% %s ", operatornames[q->operator], q->limit / 10., Util_getEventratio(a->failed, buf, sizeof(buf)));
           out_print(res, "then %s ", Util_describeAction(a->failed, buf, sizeof(buf)));
           out_print(res, "else if succeeded %s ", Util_getEventratio(a->succeeded, buf, sizeof(buf)));
           out_print(res, "then %s", Util_describeAction(a->succeeded, buf, sizeof(buf)));
@@ -2214,6 +2246,9 @@ static void print_service_params_resource(HttpResponse res, Service_T s) {
           "<tr><td>CPU usage</td><td><font%s>%.1f%%us %.1f%%sy"
         #ifdef HAVE_CPU_WAIT
           " %.1f%%wa"
+        #endif
+        #ifdef HAVE_CPU_STEAL
+          " %.1f%%hi %.1f%%st"
         #endif
           "%s",
           (s->error & Event_Resource)?" color='#ff0000'":"",
@@ -2221,8 +2256,18 @@ static void print_service_params_resource(HttpResponse res, Service_T s) {
           systeminfo.total_cpu_syst_percent > 0 ? systeminfo.total_cpu_syst_percent/10. : 0,
         #ifdef HAVE_CPU_WAIT
           systeminfo.total_cpu_wait_percent > 0 ? systeminfo.total_cpu_wait_percent/10. : 0,
+        #endif
+        #ifdef HAVE_CPU_STEAL
+          systeminfo.total_cpu_irq_percent > 0 ? systeminfo.total_cpu_irq_percent/10. : 0,
+          systeminfo.total_cpu_steal_percent > 0 ? systeminfo.total_cpu_steal_percent/10. : 0,
         #endif
           "</font></td></tr>");
+        if(systeminfo.cpu_count > 1)
+          out_print(res,
+            "<tr><td>Busiest CPU core</td><td><font%s>%.1f%% [cpu %d]</font></td></tr>",
+            (s->error & Event_Resource)?" color='#ff0000'":"",
+            systeminfo.cpu_max_percent > 0 ? systeminfo.cpu_max_percent/10. : 0,
+            systeminfo.cpu_max);
         out_print(res,
           "<tr><td>Memory usage</td><td><font%s>%ld kB [%.1f%%]</font></td></tr>",
           (s->error & Event_Resource)?" color='#ff0000'":"",
@@ -2402,6 +2447,17 @@ static void status_service_txt(Service_T s, HttpResponse res, short level) {
                   "memory percent total", s->inf->priv.process.total_mem_percent/10.0,
                   "cpu percent", s->inf->priv.process.cpu_percent/10.0,
                     "cpu percent total", s->inf->priv.process.total_cpu_percent/10.0);
+          if(s->cgroup && s->cgroup->current) {
+            out_print(res,
+                      "  %-33s %s\n",
+                      "cgroup", s->cgroup->current);
+            if(s->cgroup->read_rate >= 0)
+              out_print(res,
+                        "  %-33s %.1f kB/s\n"
+                        "  %-33s %.1f kB/s\n",
+                        "cgroup io read", s->cgroup->read_rate/1024.0,
+                        "cgroup io write", s->cgroup->write_rate/1024.0);
+          }
         }
       }
       if(s->type == TYPE_HOST && s->icmplist) {
@@ -2437,6 +2493,9 @@ static void status_service_txt(Service_T s, HttpResponse res, short level) {
           "  %-33s %.1f%%us %.1f%%sy"
         #ifdef HAVE_CPU_WAIT
           " %.1f%%wa"
+        #endif
+        #ifdef HAVE_CPU_STEAL
+          " %.1f%%hi %.1f%%st"
         #endif
           "\n"
           "  %-33s %ld kB [%.1f%%]\n"
@@ -2450,6 +2509,10 @@ static void status_service_txt(Service_T s, HttpResponse res, short level) {
           systeminfo.total_cpu_syst_percent > 0 ? systeminfo.total_cpu_syst_percent/10. : 0,
         #ifdef HAVE_CPU_WAIT
           systeminfo.total_cpu_wait_percent > 0 ? systeminfo.total_cpu_wait_percent/10. : 0,
+        #endif
+        #ifdef HAVE_CPU_STEAL
+          systeminfo.total_cpu_irq_percent > 0 ? systeminfo.total_cpu_irq_percent/10. : 0,
+          systeminfo.total_cpu_steal_percent > 0 ? systeminfo.total_cpu_steal_percent/10. : 0,
         #endif
           "memory usage",
           systeminfo.total_mem_kbyte,
@@ -2457,6 +2520,33 @@ static void status_service_txt(Service_T s, HttpResponse res, short level) {
           "swap usage",
           systeminfo.total_swap_kbyte,
           systeminfo.total_swap_percent/10.);
+        if(systeminfo.cpu_count > 1)
+          out_print(res,
+            "  %-33s %.1f%% [cpu %d]\n",
+            "busiest cpu core",
+            systeminfo.cpu_max_percent > 0 ? systeminfo.cpu_max_percent/10. : 0,
+            systeminfo.cpu_max);
+      #ifdef HAVE_PRESSURE
+        {
+          int i;
+          char name[STRLEN];
+
+          for(i = PRESSURE_CPU; i <= PRESSURE_IO; i++) {
+            if(systeminfo.pressure[PRESSURE_INDEX(i, PRESSURE_SOME, PRESSURE_AVG10)] < 0)
+              continue;
+            snprintf(name, sizeof(name), "%s pressure", pressureresourcenames[i]);
+            out_print(res,
+              "  %-33s some %.1f%% %.1f%% %.1f%%, full %.1f%% %.1f%% %.1f%%\n",
+              name,
+              systeminfo.pressure[PRESSURE_INDEX(i, PRESSURE_SOME, PRESSURE_AVG10)] > 0 ? systeminfo.pressure[PRESSURE_INDEX(i, PRESSURE_SOME, PRESSURE_AVG10)]/10. : 0,
+              systeminfo.pressure[PRESSURE_INDEX(i, PRESSURE_SOME, PRESSURE_AVG60)] > 0 ? systeminfo.pressure[PRESSURE_INDEX(i, PRESSURE_SOME, PRESSURE_AVG60)]/10. : 0,
+              systeminfo.pressure[PRESSURE_INDEX(i, PRESSURE_SOME, PRESSURE_AVG300)] > 0 ? systeminfo.pressure[PRESSURE_INDEX(i, PRESSURE_SOME, PRESSURE_AVG300)]/10. : 0,
+              systeminfo.pressure[PRESSURE_INDEX(i, PRESSURE_FULL, PRESSURE_AVG10)] > 0 ? systeminfo.pressure[PRESSURE_INDEX(i, PRESSURE_FULL, PRESSURE_AVG10)]/10. : 0,
+              systeminfo.pressure[PRESSURE_INDEX(i, PRESSURE_FULL, PRESSURE_AVG60)] > 0 ? systeminfo.pressure[PRESSURE_INDEX(i, PRESSURE_FULL, PRESSURE_AVG60)]/10. : 0,
+              systeminfo.pressure[PRESSURE_INDEX(i, PRESSURE_FULL, PRESSURE_AVG300)] > 0 ? systeminfo.pressure[PRESSURE_INDEX(i, PRESSURE_FULL, PRESSURE_AVG300)]/10. : 0);
+          }
+        }
+      #endif
       }
     }
     ctime_r((const time_t *)&s->collected.tv_sec, time);
@@ -80,6 +80,8 @@
 #include "sha.h"
 #include "state.h"
 #include "event.h"
+#include "sampler.h"
+#include "schedule.h"
 
 
 /**
@@ -125,20 +127,18 @@ ServiceGroup_T servicegrouplist;/**< The service group list (created in p.y) */
 SystemInfo_T systeminfo;                              /**< System infomation */
 
 pthread_t           heartbeatThread;           /**< M/Monit heartbeat thread */
-pthread_cond_t      heartbeatCond;            /**< Hearbeat wakeup condition */
-pthread_mutex_t     heartbeatMutex;                      /**< Hearbeat mutex */
 static volatile int heartbeatRunning = FALSE;     /**< Heartbeat thread flag */
 
 int ptreesize = 0;
-int oldptreesize = 0;
 ProcessTree_T *ptree = NULL;
-ProcessTree_T *oldptree = NULL;
 
 char actionnames[][STRLEN]   = {"ignore", "alert", "restart", "stop", "exec", "unmonitor", "start", "monitor", ""};
 char modenames[][STRLEN]     = {"active", "passive", "manual"};
 char checksumnames[][STRLEN] = {"UNKNOWN", "MD5", "SHA1"};
 char operatornames[][STRLEN] = {"greater than", "less than", "equal to", "not equal to"};
 char operatorshortnames[][3] = {">", "<", "=", "!="};
+char pressureresourcenames[][STRLEN] = {"cpu", "memory", "io"};
+char pressurenames[][STRLEN] = {"cpu pressure some avg10", "cpu pressure some avg60", "cpu pressure some avg300", "cpu pressure full avg10", "cpu pressure full avg60", "cpu pressure full avg300", "memory pressure some avg10", "memory pressure some avg60", "memory pressure some avg300", "memory pressure full avg10", "memory pressure full avg60", "memory pressure full avg300", "io pressure some avg10", "io pressure some avg60", "io pressure some avg300", "io pressure full avg10", "io pressure full avg60", "io pressure full avg300"};
 char monitornames[][STRLEN]  = {"not monitored", "monitored", "initializing"};
 char statusnames[][STRLEN]   = {"accessible", "accessible", "accessible", "running", "online with all services", "running", "accessible"};
 char servicetypes[][STRLEN]  = {"Filesystem", "Directory", "File", "Process", "Remote Host", "System", "Fifo"};
@@ -249,20 +249,6 @@ static void do_init() {
     exit(1);
   }
 
-  /*
-   * Initialize heartbeat mutex and condition
-   */
-  status = pthread_mutex_init(&heartbeatMutex, NULL);
-  if (status != 0) {
-    LogError("%s: Cannot initialize heartbeat mutex -- %s\n", prog, strerror(status));
-    exit(1);
-  }
-  status = pthread_cond_init(&heartbeatCond, NULL);
-  if (status != 0) {
-    LogError("%s: Cannot initialize heartbeat condition -- %s\n", prog, strerror(status));
-    exit(1);
-  }
-
   /* 
    * Get the position of the control file 
    */
@@ -332,13 +318,17 @@ static void do_reinit() {
   LogInfo("Reinitializing %s - Control file '%s'\n", prog, Run.controlfile);
   
   if(Run.mmonits && heartbeatRunning) {
-    if ((status = pthread_cond_signal(&heartbeatCond)) != 0)
-      LogError("%s: Failed to signal the heartbeat thread -- %s\n", prog, strerror(status));
+    Schedule_notify();
     if ((status = pthread_join(heartbeatThread, NULL)) != 0)
       LogError("%s: Failed to stop the heartbeat thread -- %s\n", prog, strerror(status));
     heartbeatRunning = FALSE;
   }
 
+  /* The process watcher, the sampler and the scheduler refer to the services which will be released */
+  delprocesswatch();
+  Sampler_stop();
+  Schedule_free();
+
   Run.doreload = FALSE;
   
   /* Stop http interface */
@@ -388,6 +378,11 @@ static void do_reinit() {
   /* send the monit startup notification */
   Event_post(Run.system, Event_Instance, STATE_CHANGED, Run.system->action_MONIT_RELOAD, "Monit reloaded");
 
+  initprocesswatch();
+  Sampler_start();
+  Schedule_init();
+
+  /* The heartbeat waits on the wakeup descriptor opened by Schedule_init() */
   if(Run.mmonits && ((status = pthread_create(&heartbeatThread, NULL, heartbeat, NULL)) != 0))
     LogError("%s: Failed to create the heartbeat thread -- %s\n", prog, strerror(status));
   else
@@ -486,13 +481,16 @@ static void do_exit() {
       monit_http(STOP_HTTP);
 
     if(Run.mmonits && heartbeatRunning) {
-      if ((status = pthread_cond_signal(&heartbeatCond)) != 0)
-        LogError("%s: Failed to signal the heartbeat thread -- %s\n", prog, strerror(status));
+      Schedule_notify();
       if ((status = pthread_join(heartbeatThread, NULL)) != 0)
         LogError("%s: Failed to stop the heartbeat thread -- %s\n", prog, strerror(status));
       heartbeatRunning = FALSE;
     }
 
+    delprocesswatch();
+    Sampler_stop();
+    Schedule_free();
+
     LogInfo("%s daemon with pid [%d] killed\n", prog, (int)getpid());
 
     /* send the monit stop notification */
@@ -558,6 +556,16 @@ static void do_default() {
     /* send the monit startup notification */
     Event_post(Run.system, Event_Instance, STATE_CHANGED, Run.system->action_MONIT_START, "Monit started");
 
+    /* Watch the monitored processes to restart them as soon as they exit */
+    initprocesswatch();
+
+    /* Sample the resources with a statistic test at a finer interval than the poll cycle */
+    Sampler_start();
+
+    /* Every service is checked at its own interval */
+    Schedule_init();
+
+    /* The heartbeat waits on the wakeup descriptor opened by Schedule_init() */
     if(Run.mmonits && ((status = pthread_create(&heartbeatThread, NULL, heartbeat, NULL)) != 0))
       LogError("%s: Failed to create the heartbeat thread -- %s\n", prog, strerror(status));
     else
@@ -567,14 +575,19 @@ static void do_default() {
       validate();
       State_save();
 
-      /* In the case that there is no pending action then sleep */
-      if (!Run.doaction)
-        sleep(Run.polltime);
+      /* In the case that there is no pending action then sleep until the next check is due
+       * or until the http thread, the process exit watcher or a signal wakes us up */
+      if (!Run.doaction && !Run.doprocessexit && !Run.dowakeup && !Run.stopped && !Run.doreload)
+        Schedule_sleep();
 
       if (Run.dowakeup) {
         Run.dowakeup = FALSE;
+        Schedule_wakeup();
         LogInfo("Awakened by User defined signal 1\n");
       }
+      /* Only the services whose process exited are due, see Schedule_update() */
+      if (Run.doprocessexit)
+        Run.doprocessexit = FALSE;
       
       if (Run.stopped)
         do_exit();
@@ -607,8 +620,8 @@ static void handle_options(int argc, char **argv) {
     case 'd':
 	Run.isdaemon = TRUE;
  	sscanf(optarg, "%d", &Run.polltime);
-	if (Run.polltime<1) {
-	  LogError("%s: option -%c requires a natural number\n", prog, opt);
+	if (Run.polltime<1 || Run.polltime>POLLTIME_MAX) {
+	  LogError("%s: option -%c requires a natural number up to %d\n", prog, opt, POLLTIME_MAX);
 	  exit(1);
 	}
 	break;
@@ -743,22 +756,12 @@ static void version() {
  */
 static void *heartbeat(void *args) {
   sigset_t ns;
-  struct timespec wait;
 
   set_signal_block(&ns, NULL);
   LogInfo("M/Monit heartbeat started\n");
-  LOCK(heartbeatMutex)
-  {
-    while (! Run.stopped && ! Run.doreload) {
-      if (handle_mmonit(NULL) == HANDLER_SUCCEEDED)
-        wait.tv_sec = time(NULL) + Run.polltime;
-      else
-        wait.tv_sec = time(NULL) + 1;
-      wait.tv_nsec = 0;
-      pthread_cond_timedwait(&heartbeatCond, &heartbeatMutex, &wait);
-    }
-  }
-  END_LOCK;
+  /* Schedule_notify() wakes the heartbeat on stop and reload */
+  while (! Run.stopped && ! Run.doreload)
+    Schedule_wait((handle_mmonit(NULL) == HANDLER_SUCCEEDED ? Run.polltime : 1) * 1000);
   LogInfo("M/Monit heartbeat stopped\n");
   return NULL;
 }
@@ -769,6 +772,7 @@ static void *heartbeat(void *args) {
  */
 static RETSIGTYPE do_reload(int sig) {
   Run.doreload = TRUE;
+  Schedule_notify();
 }
 
 
@@ -777,6 +781,7 @@ static RETSIGTYPE do_reload(int sig) {
  */
 static RETSIGTYPE do_destroy(int sig) {
   Run.stopped = TRUE;
+  Schedule_notify();
 }
 
 
@@ -785,5 +790,6 @@ static RETSIGTYPE do_destroy(int sig) {
  */
 static RETSIGTYPE do_wakeup(int sig) {
   Run.dowakeup = TRUE;
+  Schedule_notify();
 }
 
@@ -117,6 +117,7 @@
 #define SSL_TIMEOUT        15
 
 #define START_DELAY        0
+#define POLLTIME_MAX       2147483
 #define EXEC_TIMEOUT       30
 
 #define START_HTTP         1
@@ -149,6 +150,17 @@
 #define TIME_HOUR          3600
 #define TIME_DAY           86400
 
+#define SAMPLE_NONE        0
+#define SAMPLE_AVERAGE     1
+#define SAMPLE_MAXIMUM     2
+#define SAMPLE_PERCENTILE  3
+
+#define SAMPLE_CPU         0
+#define SAMPLE_CPUUSER     1
+#define SAMPLE_CPUSYSTEM   2
+#define SAMPLE_CPUWAIT     3
+#define SAMPLE_METRICS     4
+
 #define ACTION_IGNORE      0
 #define ACTION_ALERT       1
 #define ACTION_RESTART     2
@@ -184,6 +196,23 @@
 #define RESOURCE_ID_TOTAL_CPU_PERCENT 15
 #define RESOURCE_ID_SWAP_PERCENT      16
 #define RESOURCE_ID_SWAP_KBYTE        17
+#define RESOURCE_ID_CPUSTEAL          18
+#define RESOURCE_ID_CPUCORE           19
+#define RESOURCE_ID_PRESSURE          20    /* 20-37, see PRESSURE_INDEX */
+
+/* Pressure stall information: resource, kind and average window */
+#define PRESSURE_CPU       0
+#define PRESSURE_MEMORY    1
+#define PRESSURE_IO        2
+#define PRESSURE_SOME      0
+#define PRESSURE_FULL      1
+#define PRESSURE_AVG10     0
+#define PRESSURE_AVG60     1
+#define PRESSURE_AVG300    2
+#define PRESSURE_COUNT     18
+
+#define PRESSURE_INDEX(resource, kind, avg) ((resource) * 6 + (kind) * 3 + (avg))
+#define IS_RESOURCE_PRESSURE(id) ((id) >= RESOURCE_ID_PRESSURE && (id) < RESOURCE_ID_PRESSURE + PRESSURE_COUNT)
 
 #define DIGEST_CLEARTEXT   1
 #define DIGEST_CRYPT       2
@@ -414,6 +443,7 @@ typedef struct myprocesstree {
   
   int           parent;
   int          *children;
+  unsigned      seen;                          /**< Last scan cycle stamp */
 } ProcessTree_T;
 
 
@@ -431,6 +461,13 @@ typedef struct mysysteminfo {
   int    total_cpu_user_percent;   /**< Total CPU in use in user space (pct.)*/
   int    total_cpu_syst_percent; /**< Total CPU in use in kernel space (pct.)*/
   int    total_cpu_wait_percent;      /**< Total CPU in use in waiting (pct.)*/
+  int    total_cpu_irq_percent;      /**< Total CPU serving interrupts (pct.)*/
+  int    total_cpu_steal_percent;  /**< Total CPU stolen by hypervisor (pct.)*/
+  int    cpu_count;              /**< Number of entries in cpu_percent array */
+  int   *cpu_percent;                          /**< Usage of every CPU (pct.)*/
+  int    cpu_max;                             /**< Number of the busiest CPU */
+  int    cpu_max_percent;                /**< Usage of the busiest CPU (pct.)*/
+  int    pressure[PRESSURE_COUNT];        /**< Pressure stall averages (pct.)*/
   struct utsname uname;        /**< Platform information provided by uname() */
 } SystemInfo_T;
 
@@ -472,6 +509,13 @@ typedef struct myport {
   int is_available;                /**< TRUE if the server/port is available */
   double response;                      /**< Socket connection response time */
   EventAction_T action;  /**< Description of the action upon event occurence */
+  /** Result of the connection test run by a worker thread */
+  struct {
+    int    done;                    /**< TRUE if the result was not used yet */
+    int    ok;                               /**< TRUE if the test succeeded */
+    double response;                                  /**< Response time [s] */
+    char   report[STRLEN];                  /**< Error description if failed */
+  } probe;
   /** Apache-status specific parameters */
   struct apache_status {
     int loglimit;                  /**< Max percentatge of logging processes */
@@ -512,6 +556,7 @@ typedef struct myicmp {
   int timeout;              /**< The timeout in seconds to wait for response */
   int is_available;                     /**< TRUE if the server is available */
   double response;                              /**< ICMP ECHO response time */
+  int done;              /**< TRUE if the ping was run before the host check */
   EventAction_T action;  /**< Description of the action upon event occurence */
   
   /** For internal use */
@@ -549,6 +594,9 @@ typedef struct myresource {
   int  resource_id;                              /**< Which value is checked */
   long limit;                                     /**< Limit of the resource */
   int  operator;                                    /**< Comparison operator */
+  int  statistic;   /**< Statistic of the samples or SAMPLE_NONE (one delta) */
+  int  percentile;                     /**< Percentile for SAMPLE_PERCENTILE */
+  int  window;                                /**< Sampling window [seconds] */
   EventAction_T action;  /**< Description of the action upon event occurence */
   
   /** For internal use */
@@ -705,6 +753,32 @@ typedef struct myinfo {
 } *Info_T;
 
 
+/** Defines the samples of a service taken by the sampler thread */
+typedef struct mysample {
+  int     pid;                                  /**< The sampled process pid */
+  double  cputime;                  /**< Process CPU time of the last sample */
+  double  time;                                 /**< Time of the last sample */
+  int     size;                      /**< Number of samples in a ring buffer */
+  int     next;                       /**< Next position in the ring buffers */
+  int     count;                    /**< Number of valid samples, up to size */
+  int    *ring[SAMPLE_METRICS];          /**< Ring buffer per metric or NULL */
+} *Sample_T;
+
+
+/** Defines the cgroup v2 accounting of a process service */
+typedef struct mycgroup {
+  char   *path;            /**< Configured cgroup path or NULL to look it up */
+  char   *current;            /**< Path of the cgroup of the process or NULL */
+  int     pid;                 /**< Pid for which the current path was found */
+  double  time;                         /**< Time of the last cycle [1/10 s] */
+  unsigned long long cpu_usec;         /**< CPU usage of the last cycle [us] */
+  unsigned long long io_read;           /**< Bytes read until the last cycle */
+  unsigned long long io_write;       /**< Bytes written until the last cycle */
+  long    read_rate;                          /**< I/O read rate [B/s] or -1 */
+  long    write_rate;                        /**< I/O write rate [B/s] or -1 */
+} *Cgroup_T;
+
+
 /** Defines service data */
 typedef struct myservice {
 
@@ -717,8 +791,13 @@ typedef struct myservice {
   int  ncycle;                          /**< The number of the current cycle */
   int  nstart;           /**< The number of current starts with this service */
   int  every;                        /**< Check this program at given cycles */
-  int  nevery;          /**< Counter for every.  When nevery == every, check */
   int  def_every;              /**< TRUE if every is defined for the service */
+  int  interval;           /**< Check interval [ms] if defined by every or 0 */
+  long long period;                       /**< Effective check interval [ms] */
+  long long deadline;             /**< Next check time [ms, monotonic clock] */
+  int  due;                            /**< TRUE if the service check is due */
+  int  probe;       /**< TRUE if the connection tests run before the check */
+  volatile int exited;           /**< TRUE if the watched process has exited */
   int  visited;      /**< Service visited flag, set if dependencies are used */
   int  depend_visited;/**< Depend visited flag, set if dependencies are used */
   Command_T start;                    /**< The start command for the service */
@@ -763,14 +842,18 @@ typedef struct myservice {
   Info_T             inf;                          /**< Service check result */
   struct timeval     collected;                /**< When were data collected */
   int                doaction;          /**< Action scheduled by http thread */
+  int                matchpid;  /**< First process matching the pattern or 0 */
+  Sample_T           sample;      /**< Samples of the sampler thread or NULL */
+  Cgroup_T           cgroup;               /**< cgroup v2 accounting or NULL */
   char              *token;                                /**< Action token */
 
   /** Events */
   struct myevent {
-    #define           EVENT_VERSION  3      /**< The event structure version */
+    #define           EVENT_VERSION  4      /**< The event structure version */
     int               id;                      /**< The event identification */
     struct timeval    collected;                 /**< When the event occured */
     char             *source;                 /**< Event source service name */
+    struct myservice *service;     /**< Event source service, NULL if queued */
     int               mode;             /**< Monitoring mode for the service */
     int               type;                      /**< Monitored service type */
     short             state;         /**< TRUE if failed, FALSE if succeeded */
@@ -784,6 +867,9 @@ typedef struct myservice {
     struct myevent   *next;                         /**< next event in chain */
     struct myevent   *previous;                 /**< previous event in chain */
   } *eventlist;                                     /**< Pending events list */
+  struct myevent  **eventtable;          /**< Open addressed eventlist index */
+  int               eventtablesize;     /**< Number of eventtable slots, 2^n */
+  int               eventcount;                /**< Number of pending events */
 
   /** Context specific parameters */
   char *path;  /**< Path to the filesys, file, directory or process pid file */
@@ -828,9 +914,11 @@ struct myrun {
   int  init;                   /**< TRUE - don't background to run from init */
   int  facility;              /** The facility to use when running openlog() */
   int  doprocess;                 /**< TRUE if process status engine is used */
+  int  doprocessmatch; /**< TRUE if process command lines should be read */
   char *bind_addr;                  /**< The address monit http will bind to */
   volatile int  doreload;    /**< TRUE if a monit daemon should reinitialize */
   volatile int  dowakeup;  /**< TRUE if a monit daemon was wake up by signal */
+  volatile int  doprocessexit;     /**< TRUE if a watched process has exited */
   int  doaction;             /**< TRUE if some service(s) has action pending */
   mode_t umask;                /**< The initial umask monit was started with */
   int  testing;   /**< Running in configuration testing mode - TRUE or FALSE */
@@ -842,6 +930,9 @@ struct myrun {
   char *eventlist_dir;                   /**< The event queue base directory */
   int  eventlist_slots;          /**< The event queue size - number of slots */
   int  expectbuffer; /**< Generic protocol expect buffer - STRLEN by default */
+  int  processthreads;    /**< Number of the process table scan threads */
+  int  sampleinterval;         /**< Sampler interval [ms], 0 for the default */
+  int  connectionthreads;         /**< Number of the connection test threads */
 
        /** An object holding program relevant "environment" data, see; env.c */
   struct myenvironment {
@@ -884,14 +975,14 @@ extern ServiceGroup_T servicegrouplist;
 extern SystemInfo_T   systeminfo;
 extern ProcessTree_T *ptree;     
 extern int            ptreesize;    
-extern ProcessTree_T *oldptree;  
-extern int            oldptreesize; 
 
 extern char actionnames[][STRLEN];
 extern char modenames[][STRLEN];
 extern char checksumnames[][STRLEN];
 extern char operatornames[][STRLEN];
 extern char operatorshortnames[][3];
+extern char pressureresourcenames[][STRLEN];
+extern char pressurenames[][STRLEN];
 extern char monitornames[][STRLEN];
 extern char statusnames[][STRLEN];
 extern char servicetypes[][STRLEN];
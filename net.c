@@ -85,6 +85,10 @@
 #include <sys/un.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 #ifdef HAVE_NETDB_H
 #include <netdb.h>
 #endif
@@ -157,11 +161,60 @@
 
 #define DATALEN 64
 
+#ifdef HAVE_SYS_EPOLL_H
+/* The maximum number of threads resolving the host names of the probes */
+#define RESOLVER_THREADS 16
+
+/* The probe waits for the connect, PROBE_SEND and PROBE_RECEIVE follow */
+#define PROBE_CONNECT -1
+
+/* The i|o state of a port probe */
+struct probe_io {
+  Probe_T            probe;
+  int              (*step)(Probe_T);       /* The probe step or the UDP test */
+  int                socket;
+  int                action;         /* PROBE_CONNECT, PROBE_SEND or RECEIVE */
+  int                events;                  /* The epoll events waited for */
+  int                sent;                            /* Bytes of out[] sent */
+  int                closing;    /* TRUE if the test must finish, i|o failed */
+  int                host;              /* Index of the host in the resolver */
+  double             start;                      /* Start of the connect [s] */
+  double             deadline;          /* End of the current connect or i|o */
+  struct sockaddr_in address;
+};
+
+/* The distinct host names of the probes to resolve */
+struct resolver {
+  int             count;
+  int             next;                     /* The next host name to resolve */
+  const char    **hostname;
+  int            *resolved;
+  struct in_addr *address;
+  pthread_mutex_t mutex;
+};
+#endif
+
 
 /* -------------------------------------------------------------- Prototypes */
 
 
 static int do_connect(int, const struct sockaddr *, socklen_t, int);
+#ifdef HAVE_SYS_EPOLL_H
+static double get_time(void);
+static void   resolve_ports(struct probe_io *, int);
+static int    compare_hostname(const void *, const void *);
+static void  *resolve_thread(void *);
+static void   resolve_hosts(struct resolver *);
+static void   probe_start(int, struct probe_io *);
+static void   probe_event(int, struct probe_io *, double);
+static void   probe_timeout(int, struct probe_io *, double);
+static void   probe_step(int, struct probe_io *, double);
+static int    probe_wait(int, struct probe_io *, int, double);
+static int    probe_write(struct probe_io *);
+static void   probe_abort(int, struct probe_io *, double);
+static void   probe_close(struct probe_io *);
+static int    probe_udp(Probe_T);
+#endif
 static unsigned short checksum_ip(unsigned char *, int);
 
 
@@ -358,6 +411,115 @@ int create_unix_socket(const char *pathname, int timeout) {
 }
 
 
+/**
+ * Test the given ports in parallel. The host names are resolved first,
+ * every distinct name once and by more threads, then the non blocking
+ * connects are started at once and the sockets are multiplexed over
+ * epoll. The connect, every send and every receive of a port is given
+ * the port timeout, the response time is measured from the start of
+ * its connect until the protocol test finished.
+ * @param probes The port probes
+ * @param count Number of probes
+ * @return TRUE if the ports were tested, FALSE if the parallel
+ * test is not supported on this platform
+ */
+int probe_ports(Probe_T *probes, int count) {
+#ifdef HAVE_SYS_EPOLL_H
+  int                 i;
+  int                 n;
+  int                 fd;
+  int                 pending;
+  double              now;
+  struct probe_io    *io;
+  struct epoll_event *events;
+
+  ASSERT(probes);
+
+  if (count <= 0)
+    return TRUE;
+
+  if ((fd = epoll_create(count)) < 0) {
+    LogError("%s: Cannot create epoll descriptor -- %s\n", prog, STRERROR);
+    return FALSE;
+  }
+  io     = xcalloc(sizeof(struct probe_io), count);
+  events = xcalloc(sizeof(struct epoll_event), count);
+
+  for (i = 0; i < count; i++) {
+    Probe_T P = probes[i];
+
+    P->state     = 0;
+    P->inlength  = 0;
+    P->eof       = FALSE;
+    P->connected = FALSE;
+    P->failed    = FALSE;
+    P->error     = 0;
+    P->response  = -1;
+    P->timeout   = P->port->timeout;
+    io[i].probe  = P;
+    io[i].socket = -1;
+    io[i].step   = P->step ? P->step : P->port->type == SOCK_DGRAM && P->port->family != AF_UNIX ? probe_udp : NULL;
+  }
+
+  /* Resolve the host names before the timeouts start */
+  resolve_ports(io, count);
+
+  /* Start all connects */
+  for (i = 0; i < count; i++) {
+    if (io[i].probe->error)
+      io[i].probe->failed = TRUE;
+    else
+      probe_start(fd, &io[i]);
+  }
+
+  /* Run the tests until all finished or timed out */
+  for (;;) {
+    int timeout = -1;
+
+    now = get_time();
+    for (i = 0, pending = 0; i < count; i++) {
+      if (io[i].socket >= 0 && io[i].deadline <= now)
+        probe_timeout(fd, &io[i], now);
+      if (io[i].socket >= 0) {
+        int left = (int)((io[i].deadline - now) * 1000) + 1;
+        if (timeout < 0 || left < timeout)
+          timeout = left;
+        pending++;
+      }
+    }
+    if (! pending)
+      break;
+
+    if ((n = epoll_wait(fd, events, count, timeout)) < 0) {
+      int status = errno;
+
+      if (status == EINTR)
+        continue;
+      LogError("%s: Connection wait failed -- %s\n", prog, strerror(status));
+      for (i = 0; i < count; i++) {
+        if (io[i].socket >= 0) {
+          io[i].probe->error = status;
+          probe_abort(fd, &io[i], now);
+        }
+      }
+      break;
+    }
+
+    now = get_time();
+    while (n-- > 0)
+      probe_event(fd, events[n].data.ptr, now);
+  }
+
+  FREE(events);
+  FREE(io);
+  close(fd);
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
+
 /**
  * Create a non-blocking server socket and bind it to the specified local
  * port number, with the specified backlog. Set a socket option to
@@ -831,6 +993,409 @@ static int do_connect(int s, const struct sockaddr *addr, socklen_t addrlen, int
 }
 
 
+#ifdef HAVE_SYS_EPOLL_H
+/*
+ * Get the time of the probe clock [s]
+ */
+static double get_time() {
+  struct timeval t;
+
+  gettimeofday(&t, NULL);
+  return (double)t.tv_sec + (double)t.tv_usec / 1000000;
+}
+
+
+/*
+ * Resolve the addresses of the TCP and UDP ports. Every distinct host
+ * name is looked up once, the lookups are run by up to RESOLVER_THREADS
+ * threads, so a slow name server delays the tests by about one lookup.
+ * The probes of the hosts which don't resolve get EHOSTUNREACH.
+ */
+static void resolve_ports(struct probe_io *io, int count) {
+  int               i;
+  int               n;
+  int               threads;
+  pthread_t        *thread;
+  struct probe_io **sorted;
+  struct resolver   R;
+
+  memset(&R, 0, sizeof(R));
+  sorted = xcalloc(sizeof(struct probe_io *), count);
+  for (i = 0, n = 0; i < count; i++)
+    if (io[i].probe->port->family != AF_UNIX)
+      sorted[n++] = &io[i];
+  if (! n) {
+    FREE(sorted);
+    return;
+  }
+  qsort(sorted, n, sizeof(struct probe_io *), compare_hostname);
+
+  R.hostname = xcalloc(sizeof(char *), n);
+  R.address  = xcalloc(sizeof(struct in_addr), n);
+  R.resolved = xcalloc(sizeof(int), n);
+  for (i = 0; i < n; i++) {
+    const char *hostname = sorted[i]->probe->port->hostname;
+
+    if (! R.count || strcmp(R.hostname[R.count - 1], hostname))
+      R.hostname[R.count++] = hostname;
+    sorted[i]->host = R.count - 1;
+  }
+
+  /* The main thread resolves the names which were not taken by a thread */
+  pthread_mutex_init(&R.mutex, NULL);
+  threads = MIN(R.count - 1, RESOLVER_THREADS);
+  thread  = xcalloc(sizeof(pthread_t), MAX(threads, 1));
+  for (i = 0; i < threads; i++) {
+    int status;
+
+    if ((status = pthread_create(&thread[i], NULL, resolve_thread, &R)) != 0) {
+      LogError("%s: Failed to create the resolver thread -- %s\n", prog, strerror(status));
+      break;
+    }
+  }
+  resolve_hosts(&R);
+  while (i-- > 0)
+    pthread_join(thread[i], NULL);
+  pthread_mutex_destroy(&R.mutex);
+
+  for (i = 0; i < n; i++) {
+    struct probe_io *p = sorted[i];
+
+    if (R.resolved[p->host]) {
+      p->address.sin_family = AF_INET;
+      p->address.sin_addr   = R.address[p->host];
+      p->address.sin_port   = htons(p->probe->port->port);
+    } else {
+      p->probe->error = EHOSTUNREACH;
+    }
+  }
+
+  FREE(thread);
+  FREE(R.resolved);
+  FREE(R.address);
+  FREE(R.hostname);
+  FREE(sorted);
+}
+
+
+/*
+ * Order the probes by the host name
+ */
+static int compare_hostname(const void *a, const void *b) {
+  return strcmp((*(struct probe_io **)a)->probe->port->hostname, (*(struct probe_io **)b)->probe->port->hostname);
+}
+
+
+/*
+ * The resolver thread
+ */
+static void *resolve_thread(void *args) {
+  sigset_t ns;
+
+  set_signal_block(&ns, NULL);
+  resolve_hosts(args);
+  return NULL;
+}
+
+
+/*
+ * Resolve the host names until none is left
+ */
+static void resolve_hosts(struct resolver *R) {
+  for (;;) {
+    int              i = -1;
+    struct addrinfo  hints;
+    struct addrinfo *result;
+
+    LOCK(R->mutex)
+    {
+      if (R->next < R->count)
+        i = R->next++;
+    }
+    END_LOCK;
+    if (i < 0)
+      break;
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family = AF_INET;
+    if (getaddrinfo(R->hostname[i], NULL, &hints, &result) == 0) {
+      R->address[i]  = ((struct sockaddr_in *)result->ai_addr)->sin_addr;
+      R->resolved[i] = TRUE;
+      freeaddrinfo(result);
+    }
+  }
+}
+
+
+/*
+ * Start a non blocking connect to the port. The TCP and UDP port
+ * address was resolved by resolve_ports().
+ */
+static void probe_start(int fd, struct probe_io *io) {
+  int                rv;
+  Probe_T            P = io->probe;
+  struct sockaddr_un unixsocket;
+
+  io->start = get_time();
+  if (P->port->family == AF_UNIX) {
+    if ((io->socket = socket(PF_UNIX, SOCK_STREAM, 0)) < 0)
+      goto error;
+    memset(&unixsocket, 0, sizeof(unixsocket));
+    unixsocket.sun_family = AF_UNIX;
+    snprintf(unixsocket.sun_path, sizeof(unixsocket.sun_path), "%s", P->port->pathname);
+  } else {
+    if ((io->socket = socket(AF_INET, P->port->type == SOCK_DGRAM ? SOCK_DGRAM : SOCK_STREAM, 0)) < 0)
+      goto error;
+  }
+
+  if (! set_noblock(io->socket) || fcntl(io->socket, F_SETFD, FD_CLOEXEC) == -1)
+    goto error;
+
+  if (P->port->family == AF_UNIX)
+    rv = connect(io->socket, (struct sockaddr *)&unixsocket, sizeof(unixsocket));
+  else
+    rv = connect(io->socket, (struct sockaddr *)&io->address, sizeof(struct sockaddr_in));
+  if (rv == 0) {
+    P->connected = TRUE;
+    probe_step(fd, io, io->start);
+    return;
+  }
+  if (errno == EINPROGRESS && probe_wait(fd, io, PROBE_CONNECT, io->start))
+    return;
+
+  error:
+  P->error = errno;
+  probe_abort(fd, io, io->start);
+}
+
+
+/*
+ * Handle the epoll event of the probe socket
+ */
+static void probe_event(int fd, struct probe_io *io, double now) {
+  int       n;
+  int       status = 0;
+  socklen_t len = sizeof(status);
+  Probe_T   P = io->probe;
+
+  switch (io->action) {
+    case PROBE_CONNECT:
+      if (getsockopt(io->socket, SOL_SOCKET, SO_ERROR, &status, &len) < 0)
+        status = errno;
+      if (status) {
+        P->error = status;
+        probe_abort(fd, io, now);
+        return;
+      }
+      P->connected = TRUE;
+      break;
+    case PROBE_SEND:
+      if (! probe_write(io)) {
+        P->error = errno;
+        P->eof = TRUE;
+        io->closing = TRUE;
+      } else if (io->sent < P->outlength) {
+        io->deadline = now + P->timeout;
+        return;
+      }
+      break;
+    case PROBE_RECEIVE:
+      do {
+        n = read(io->socket, P->in + P->inlength, P->insize - P->inlength);
+      } while (n == -1 && errno == EINTR);
+      if (n > 0) {
+        P->inlength += n;
+      } else if (n == 0) {
+        P->eof = TRUE;
+      } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return;
+      } else {
+        P->error = errno;
+        P->eof = TRUE;
+      }
+      break;
+  }
+  probe_step(fd, io, now);
+}
+
+
+/*
+ * Handle the timeout of the connect, send or receive. The receive
+ * timeout ends the input like the end of file, as in socket_read().
+ */
+static void probe_timeout(int fd, struct probe_io *io, double now) {
+  Probe_T P = io->probe;
+
+  if (io->action == PROBE_RECEIVE) {
+    P->eof = TRUE;
+    probe_step(fd, io, now);
+    return;
+  }
+  P->error = ETIMEDOUT;
+  probe_abort(fd, io, now);
+}
+
+
+/*
+ * Run the protocol test of the connected port until it waits for i|o
+ * or finished. The end of the input is reported to the test with eof
+ * once, the test may go on sending and receiving. After a failed send
+ * the test is called with eof until it finished, so it can free its
+ * data, and it fails.
+ */
+static void probe_step(int fd, struct probe_io *io, double now) {
+  Probe_T P = io->probe;
+
+  for (;;) {
+    int action = io->step ? io->step(P) : PROBE_DONE;
+
+    if (io->closing && action != PROBE_DONE) {
+      P->eof = TRUE;
+      continue;
+    }
+    switch (action) {
+      case PROBE_SEND:
+        P->eof = FALSE;
+        io->sent = 0;
+        if (! probe_write(io)) {
+          P->error = errno;
+          P->eof = TRUE;
+          io->closing = TRUE;
+          continue;
+        }
+        if (io->sent == P->outlength)
+          continue;
+        break;
+      case PROBE_RECEIVE:
+        P->eof = FALSE;
+        if (P->inlength >= P->insize) {
+          P->eof = TRUE;
+          io->closing = TRUE;
+          continue;
+        }
+        break;
+      default:
+        if (io->closing)
+          P->failed = TRUE;
+        if (! P->failed)
+          P->response = now - io->start;
+        probe_close(io);
+        return;
+    }
+    if (probe_wait(fd, io, action, now))
+      return;
+    P->error = errno;
+    P->eof = TRUE;
+    io->closing = TRUE;
+  }
+}
+
+
+/*
+ * Wait for the socket to become ready for the action
+ */
+static int probe_wait(int fd, struct probe_io *io, int action, double now) {
+  struct epoll_event event;
+
+  memset(&event, 0, sizeof(event));
+  event.events   = action == PROBE_RECEIVE ? EPOLLIN : EPOLLOUT;
+  event.data.ptr = io;
+  if (! io->events || io->events != event.events) {
+    if (epoll_ctl(fd, io->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, io->socket, &event) < 0)
+      return FALSE;
+    io->events = event.events;
+  }
+  io->action   = action;
+  io->deadline = now + (action == PROBE_CONNECT ? io->probe->port->timeout : io->probe->timeout);
+  return TRUE;
+}
+
+
+/*
+ * Send the rest of the probe output without blocking
+ */
+static int probe_write(struct probe_io *io) {
+  int     n;
+  Probe_T P = io->probe;
+
+  while (io->sent < P->outlength) {
+    do {
+      n = write(io->socket, P->out + io->sent, P->outlength - io->sent);
+    } while (n == -1 && errno == EINTR);
+    if (n < 0)
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    io->sent += n;
+  }
+  return TRUE;
+}
+
+
+/*
+ * End the test of the port which failed before the protocol test
+ * started or in the middle of it
+ */
+static void probe_abort(int fd, struct probe_io *io, double now) {
+  Probe_T P = io->probe;
+
+  if (P->connected && io->step && ! io->closing) {
+    P->eof = TRUE;
+    io->closing = TRUE;
+    probe_step(fd, io, now);
+    return;
+  }
+  P->failed = TRUE;
+  probe_close(io);
+}
+
+
+/*
+ * Close the socket of the finished probe, which also removes it from
+ * the epoll set
+ */
+static void probe_close(struct probe_io *io) {
+  if (io->socket >= 0) {
+    close_socket(io->socket);
+    io->socket = -1;
+  }
+}
+
+
+/*
+ * Test the UDP port without a protocol test. We have to send something
+ * and if the UDP server is down/unreachable the remote host should send
+ * an ICMP error, which is returned by the read as ECONNREFUSED. This is
+ * asynchronous, so we wait up to 2 seconds; it is probably better to
+ * report the server falsely up than to block too long.
+ */
+static int probe_udp(Probe_T P) {
+  static const char zero = 0;
+
+  if (P->eof) {
+    FREE(P->data);
+    P->in = NULL;
+    if (P->error == ECONNREFUSED)
+      P->failed = TRUE;
+    return PROBE_DONE;
+  }
+  switch (P->state++) {
+    case 0:
+      P->out       = &zero;
+      P->outlength = 1;
+      return PROBE_SEND;
+    case 1:
+      P->data    = xcalloc(sizeof(char), STRLEN);
+      P->in      = P->data;
+      P->insize  = STRLEN;
+      P->timeout = 2;
+      return PROBE_RECEIVE;
+    default:
+      FREE(P->data);
+      P->in = NULL;
+      return PROBE_DONE;
+  }
+}
+#endif
+
+
 /*
  * Compute Internet Checksum for "count" bytes beginning at location "addr".
  * Based on RFC1071.
@@ -53,6 +53,34 @@
 #define NET_TIMEOUT 5
 
 
+/**
+ * The step function results of a port probe
+ */
+#define PROBE_DONE     0                     /**< The protocol test finished */
+#define PROBE_SEND     1           /**< Send out[], then call the step again */
+#define PROBE_RECEIVE  2    /**< Receive into in[], then call the step again */
+
+
+/** Defines a non blocking port test run by probe_ports() */
+typedef struct myprobe {
+  Port_T port;                                         /**< The port to test */
+  int  (*step)(struct myprobe *); /**< Protocol test or NULL to connect only */
+  int    state;                                     /**< Protocol test state */
+  void  *data;                               /**< Protocol test private data */
+  const char *out;                                         /**< Data to send */
+  int    outlength;                              /**< Length of the out data */
+  char  *in;                                             /**< Receive buffer */
+  int    insize;                                    /**< Receive buffer size */
+  int    inlength;                          /**< Length of the received data */
+  int    eof;  /**< TRUE if nothing more is received (EOF, error or timeout) */
+  int    timeout;                      /**< The send and receive timeout [s] */
+  int    connected;                      /**< TRUE if the port was connected */
+  int    failed;                       /**< TRUE if the protocol test failed */
+  int    error;                    /**< errno of the failed i|o or 0 if none */
+  double response;           /**< The test time [s] or -1 if the test failed */
+} *Probe_T;
+
+
 /**
  * Check if the hostname resolves
  * @param hostname The host to check
@@ -110,6 +138,26 @@ int create_generic_socket(Port_T p);
 int create_unix_socket(const char *pathname, int timeout);
 
 
+/**
+ * Test the given ports in parallel. The host names are resolved first,
+ * then the non blocking connects are started at once and the sockets
+ * are multiplexed over epoll. A probe without a step function only
+ * connects, a UDP port is sent one byte and must not answer with an
+ * ICMP error within 2 seconds. The step function of a protocol test is
+ * called after the connect, after the output was sent and after every
+ * received chunk, it returns what to do next. When nothing more can be
+ * received the step is called with eof set. If a send failed, the step
+ * is called with eof until it returns PROBE_DONE, so it can free its
+ * data, and the probe fails. The timeout of the port is applied to the
+ * connect and to every send and receive, as socket_read() does.
+ * @param probes The port probes
+ * @param count Number of probes
+ * @return TRUE if the ports were tested, FALSE if the parallel
+ * test is not supported on this platform
+ */
+int probe_ports(Probe_T *probes, int count);
+
+
 /**
  * Create a blocking server socket and bind it to the specified local
  * port number, with the specified backlog. Set a socket option to
@@ -203,6 +203,7 @@
   static void  addservicegroup(char *);
   static void  addport(Port_T);
   static void  addresource(Resource_T);
+  static void  addcgroup(char *);
   static void  addtimestamp(Timestamp_T, int);
   static void  addactionrate(ActionRate_T);
   static void  addsize(Size_T);
@@ -274,6 +275,8 @@
 %token READONLY CLEARTEXT MD5HASH SHA1HASH CRYPT DELAY
 %token PEMFILE ENABLE DISABLE HTTPDSSL CLIENTPEMFILE ALLOWSELFCERTIFICATION
 %token IDFILE STATEFILE SEND EXPECT EXPECTBUFFER CYCLE COUNT REMINDER
+%token PROCESSTABLE THREADS
+%token SAMPLER MILLISECOND AVERAGE MAXIMUM PERCENTILE CGROUP
 %token PIDFILE START STOP PATHTOK
 %token HOST HOSTNAME PORT TYPE UDP TCP TCPSSL PROTOCOL CONNECTION
 %token ALERT NOALERT MAILFORMAT UNIXSOCKET SIGNATURE
@@ -290,6 +293,8 @@
 %token CHILDREN SYSTEM
 %token RESOURCE MEMORY TOTALMEMORY LOADAVG1 LOADAVG5 LOADAVG15 SWAP
 %token MODE ACTIVE PASSIVE MANUAL CPU TOTALCPU CPUUSER CPUSYSTEM CPUWAIT
+%token CPUSTEAL CPUCORE
+%token <number> PRESSURE
 %token GROUP REQUEST DEPENDS BASEDIR SLOT EVENTQUEUE SECRET HOSTHEADER
 %token UID GID MMONIT INSTANCE USERNAME PASSWORD
 %token TIMESTAMP CHANGED SECOND MINUTE HOUR DAY
@@ -328,6 +333,9 @@ statement       : setalert
                 | setidfile
                 | setstatefile
                 | setexpectbuffer
+                | setprocesstable
+                | setsampler
+                | setconnectionthreads
                 | setinit
                 | setfips
                 | checkproc optproclist
@@ -358,6 +366,7 @@ optproc         : start
                 | group
                 | depend
                 | resourceprocess
+                | cgroup
                 ;
 
 optfilelist      : /* EMPTY */
@@ -496,6 +505,8 @@ setalert        : SET alertmail '{' eventoptionlist '}' formatlist reminder {
                 ;
 
 setdaemon       : SET DAEMON NUMBER startdelay {
+                    if ($3 < 1 || $3 > POLLTIME_MAX)
+                      yyerror2("The daemon poll time must be between 1 and %d seconds", POLLTIME_MAX);
                     if (!Run.isdaemon || ihp.daemon) {
                       ihp.daemon     = TRUE;
                       Run.isdaemon   = TRUE;
@@ -514,6 +525,27 @@ setexpectbuffer : SET EXPECTBUFFER NUMBER unit {
                   }
                 ;
 
+setprocesstable : SET PROCESSTABLE THREADS NUMBER {
+                    if ($4 < 1)
+                      yyerror2("The number of process table threads must be greater than zero");
+                    Run.processthreads = $4;
+                  }
+                ;
+
+setconnectionthreads : SET CONNECTION THREADS NUMBER {
+                    if ($4 < 1)
+                      yyerror2("The number of connection test threads must be greater than zero");
+                    Run.connectionthreads = $4;
+                  }
+                ;
+
+setsampler      : SET SAMPLER NUMBER MILLISECOND {
+                    if ($3 < 10 || $3 > 60000)
+                      yyerror2("The sampler interval must be between 10 and 60000 milliseconds");
+                    Run.sampleinterval = $3;
+                  }
+                ;
+
 setinit         : SET INIT {
                     Run.init = TRUE;
                   }
@@ -1295,9 +1327,22 @@ every           : EVERY NUMBER CYCLE {
                    check_every($2);
                    current->def_every = TRUE;
                    current->every = $2;
+                   current->interval = 0;
+                 }
+                | EVERY NUMBER interval {
+                   if ($2 < 1 || (long long)$2 * $<number>3 > 86400000)
+                     yyerror2("an EVERY interval must be between 1 millisecond and 1 day");
+                   current->def_every = FALSE;
+                   current->interval = $2 * $<number>3;
                  }
                 ;
 
+interval        : MILLISECOND { $<number>$ = 1; }
+                | SECOND      { $<number>$ = 1000; }
+                | MINUTE      { $<number>$ = 60000; }
+                | HOUR        { $<number>$ = 3600000; }
+                ;
+
 mode            : MODE ACTIVE  {
                     current->mode = MODE_ACTIVE;
                   }
@@ -1324,6 +1369,14 @@ dependlist      : dependant
 dependant       : SERVICENAME { adddependant($<string>1); }
                 ;
 
+cgroup          : CGROUP {
+                    addcgroup(NULL);
+                  }
+                | CGROUP PATH {
+                    addcgroup($2);
+                  }
+                ;
+
 resourceprocess : IF resourceprocesslist rate1 THEN action1 recovery {
                      addeventaction(&(resourceset).action, $<number>5, $<number>6);
                      addresource(&resourceset);
@@ -1354,12 +1407,13 @@ resourcesystemopt  : resourceload
                    | resourcemem
                    | resourceswap
                    | resourcecpu
+                   | resourcepressure
                    ;
 
-resourcecpuproc : CPU operator NUMBER PERCENT {
+resourcecpuproc : CPU samplestat operator NUMBER PERCENT {
                     resourceset.resource_id = RESOURCE_ID_CPU_PERCENT;
-                    resourceset.operator = $<number>2;
-                    resourceset.limit = ($3 * 10); 
+                    resourceset.operator = $<number>3;
+                    resourceset.limit = ($4 * 10); 
                   }
                 | TOTALCPU operator NUMBER PERCENT {
                     resourceset.resource_id = RESOURCE_ID_TOTAL_CPU_PERCENT;
@@ -1368,16 +1422,45 @@ resourcecpuproc : CPU operator NUMBER PERCENT {
                   }
                 ;
 
-resourcecpu     : resourcecpuid operator NUMBER PERCENT {
+resourcecpu     : resourcecpuid samplestat operator NUMBER PERCENT {
+                    if (resourceset.statistic != SAMPLE_NONE && $<number>1 != RESOURCE_ID_CPUUSER && $<number>1 != RESOURCE_ID_CPUSYSTEM && $<number>1 != RESOURCE_ID_CPUWAIT)
+                      yyerror2("Sampled statistics are supported only for the cpu user, system and wait usage");
                     resourceset.resource_id = $<number>1;
-                    resourceset.operator = $<number>2;
-                    resourceset.limit = ($3 * 10); 
+                    resourceset.operator = $<number>3;
+                    resourceset.limit = ($4 * 10); 
+                  }
+                ;
+
+samplestat      : /* EMPTY */
+                | AVERAGE NUMBER time {
+                    resourceset.statistic = SAMPLE_AVERAGE;
+                    resourceset.window = $2 * $<number>3;
+                  }
+                | MAXIMUM NUMBER time {
+                    resourceset.statistic = SAMPLE_MAXIMUM;
+                    resourceset.window = $2 * $<number>3;
+                  }
+                | PERCENTILE NUMBER NUMBER time {
+                    if ($2 < 1 || $2 > 100)
+                      yyerror2("The percentile must be between 1 and 100");
+                    resourceset.statistic = SAMPLE_PERCENTILE;
+                    resourceset.percentile = $2;
+                    resourceset.window = $3 * $<number>4;
                   }
                 ;
 
 resourcecpuid   : CPUUSER   { $<number>$ = RESOURCE_ID_CPUUSER; }
                 | CPUSYSTEM { $<number>$ = RESOURCE_ID_CPUSYSTEM; }
                 | CPUWAIT   { $<number>$ = RESOURCE_ID_CPUWAIT; }
+                | CPUSTEAL  { $<number>$ = RESOURCE_ID_CPUSTEAL; }
+                | CPUCORE   { $<number>$ = RESOURCE_ID_CPUCORE; }
+                ;
+
+resourcepressure : PRESSURE operator value PERCENT {
+                    resourceset.resource_id = $1;
+                    resourceset.operator = $<number>2;
+                    resourceset.limit = (int) ($<real>3 * 10.0); 
+                  }
                 ;
 
 resourcemem     : MEMORY operator value unit {
@@ -1802,6 +1885,7 @@ int parse(char *controlfile) {
   ASSERT(controlfile);
 
   servicelist = tail = current = NULL;
+  Util_resetServiceIndex();
 
   /*
    * Secure check the monitrc file. The run control file must have the
@@ -1882,6 +1966,7 @@ static void preparse() {
   Run.dolog               = FALSE;
   Run.dohttpd             = FALSE;
   Run.doaction            = FALSE;
+  Run.doprocessmatch      = FALSE;
   Run.httpdsig            = TRUE;
   Run.dommonitcredentials = TRUE;
   Run.mmonitcredentials   = NULL;
@@ -1897,6 +1982,9 @@ static void preparse() {
   Run.eventlist_slots     = -1;
   Run.system              = NULL;
   Run.expectbuffer        = STRLEN;
+  Run.processthreads      = 1;
+  Run.sampleinterval      = 0;
+  Run.connectionthreads   = 1;
   Run.mmonits             = NULL;
   Run.maillist            = NULL;
   Run.mailservers         = NULL;
@@ -1958,6 +2046,9 @@ static void postparse() {
     /* Set the general system service shortcut */
     if (s->type == TYPE_SYSTEM)
       Run.system = s;
+    /* The process command line is read only if some process is matched by pattern */
+    if (s->type == TYPE_PROCESS && s->matchlist)
+      Run.doprocessmatch = TRUE;
     if (s->type != TYPE_HOST)
 	continue;
     /* Verify that a remote service has a port or an icmp list */
@@ -1967,6 +2058,9 @@ static void postparse() {
     }
   }
 
+  /* Compile the process matching patterns */
+  initprocessmatch(servicelist);
+
   if (Run.mmonits) {
     if (Run.dohttpd) {
       if (Run.dommonitcredentials) {
@@ -2054,6 +2148,7 @@ static void addservice(Service_T s) {
     servicelist_conf = n;
   }
   tail = n;
+  Util_indexService(n);
 }
 
 
@@ -2197,10 +2292,21 @@ static void addresource(Resource_T rr) {
   NEW(r);
   if (! Run.doprocess)
     yyerror("Cannot activate service check. The process status engine was disabled. On certain systems you must run monit as root to utilize this feature)\n");
+  if (rr->statistic != SAMPLE_NONE) {
+#ifdef HAVE_SAMPLER
+    if (rr->window <= 0)
+      yyerror2("The sampling window must be greater than zero");
+#else
+    yyerror2("Sampled statistics are not supported on this platform");
+#endif
+  }
   r->resource_id = rr->resource_id;
   r->limit       = rr->limit;
   r->action      = rr->action;
   r->operator    = rr->operator;
+  r->statistic   = rr->statistic;
+  r->percentile  = rr->percentile;
+  r->window      = rr->window;
   r->next        = current->resourcelist;
 
   current->resourcelist = r;
@@ -2208,6 +2314,28 @@ static void addresource(Resource_T rr) {
 }
 
 
+/*
+ * Set the cgroup v2 accounting of the current service, the path is
+ * looked up by the process pid if not given
+ */
+static void addcgroup(char *path) {
+#ifdef HAVE_CGROUP
+  if (current->cgroup) {
+    yyerror2("The cgroup is already defined");
+    FREE(path);
+    return;
+  }
+  NEW(current->cgroup);
+  current->cgroup->path       = path;
+  current->cgroup->read_rate  = -1;
+  current->cgroup->write_rate = -1;
+#else
+  yyerror2("The cgroup accounting is not supported on this platform");
+  FREE(path);
+#endif
+}
+
+
 /*
  * Add a new file object to the current service timestamp list
  */
@@ -3208,6 +3336,9 @@ static void reset_resourceset() {
   resourceset.limit = 0;
   resourceset.action = NULL;
   resourceset.operator = OPERATOR_EQUAL;
+  resourceset.statistic = SAMPLE_NONE;
+  resourceset.percentile = 0;
+  resourceset.window = 0;
 }
 
 
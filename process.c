@@ -57,11 +57,32 @@
 #include <string.h>
 #endif
 
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_SIGNAL_H
+#include <signal.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
+
 #include <stdio.h>
 
 #include "monitor.h"
 #include "process.h"
 #include "process_sysdep.h"
+#include "schedule.h"
 
 /**
  *  General purpose /proc methods.
@@ -73,6 +94,835 @@
  */
 
 
+/* ------------------------------------------------------------- Definitions */
+
+
+/* Minimal process age [s] when the command line was read to reuse it - it
+ * allows the process to settle, some programs rewrite argv after start */
+#define CMDLINE_SETTLE_TIME 2
+
+/* The pid of an unused process tree slot */
+#define SLOT_FREE           -1
+
+/* Minimal process tree size for compacting the unused slots */
+#define SLOT_COMPACT_MIN    1024
+
+
+/** Defines pid -> process tree index hash */
+typedef struct myprocessindex {
+  ProcessTree_T *pt;                    /**< The process tree being indexed */
+  int            size;             /**< Number of hash slots (power of two) */
+  int            used;                      /**< Number of hash slots in use */
+  int           *slot;         /**< Tree index + 1, or 0 if slot is empty */
+} ProcessIndex_T;
+
+
+/** Defines the process tree slot table state kept across cycles */
+static struct myprocessslots {
+  unsigned       cycle;                          /**< The scan cycle counter */
+  int            capacity;              /**< Allocated process tree entries */
+  int           *free;                    /**< Stack of unused tree entries */
+  int            freenum;                  /**< Number of unused tree entries */
+  int            freesize;                   /**< Allocated free stack size */
+  int           *children;  /**< Children of all processes, grouped by parent */
+  int            childrensize;           /**< Allocated children array size */
+  ProcessIndex_T index;                          /**< pid -> tree index hash */
+  ProcessAggregate_T aggregate;            /**< Tree aggregation work arrays */
+  ProcessTree_T *scan;     /**< Process table scan buffer, reused by sysdep */
+} slots;
+
+
+/** Defines the process matching pattern */
+typedef struct myprocesspattern {
+  Match_T   match;                                   /**< The match pattern */
+  Service_T service;            /**< The service or NULL for the test match */
+  char     *literal;            /**< Text which any match contains or NULL */
+  int       samenext;    /**< Next pattern with the same literal or -1 */
+  int       found;    /**< Tree index of the first matching process or -1 */
+  unsigned  stamp;                    /**< The last tested command line */
+  int       pid;                 /**< The process matched by the last scan */
+  time_t    starttime;    /**< Start time of the process matched last time */
+} ProcessPattern_T;
+
+
+/** Defines the literal prefilter automaton node (Aho-Corasick) */
+typedef struct myprocessmatchnode {
+  int edge;                                       /**< First outgoing edge */
+  int fail;                 /**< Node of the longest proper suffix in trie */
+  int output;             /**< First pattern whose literal ends here or -1 */
+  int dict;         /**< Nearest node on the fail chain with output or -1 */
+} ProcessMatchNode_T;
+
+
+/** Defines the literal prefilter automaton edge */
+typedef struct myprocessmatchedge {
+  unsigned char c;                                    /**< Edge character */
+  int           node;                                   /**< Target node */
+  int           next;                        /**< Next edge of the node */
+} ProcessMatchEdge_T;
+
+
+/** Defines the combined matcher of the process matching patterns */
+typedef struct myprocessmatcher {
+  ProcessPattern_T   *pattern;                        /**< Match patterns */
+  int                 count;                /**< Number of match patterns */
+  int                 open;       /**< Number of patterns without a match */
+  int                *scan;         /**< Patterns without literal prefilter */
+  int                 scancount;         /**< Number of scan only patterns */
+  ProcessMatchNode_T *node;                       /**< The automaton nodes */
+  int                 nodecount;                     /**< Number of nodes */
+  ProcessMatchEdge_T *edge;                       /**< The automaton edges */
+  int                 edgecount;                     /**< Number of edges */
+  unsigned            stamp;               /**< The command line counter */
+} ProcessMatcher_T;
+
+
+/** The matcher of all process services using the "matching" statement */
+static ProcessMatcher_T matcher;
+
+
+/** Defines the process watched for exit */
+typedef struct myprocesswatch {
+  Service_T service;                                /**< The process service */
+  int       pid;                                      /**< The process pid */
+  int       fd;                             /**< The process file descriptor */
+} ProcessWatch_T;
+
+
+/** The process exit watcher state */
+static struct myprocesswatcher {
+  int             running;               /**< TRUE if the watcher is running */
+  int             pipe[2];           /**< Wakes up the watcher on any change */
+  ProcessWatch_T *watch;                            /**< The watched processes */
+  int             count;                  /**< Number of watched processes */
+  int            *closed;       /**< Descriptors to be closed by the watcher */
+  int             closedcount;          /**< Number of descriptors to close */
+  pthread_t       thread;                           /**< The watcher thread */
+} watcher;
+
+static pthread_mutex_t watcherMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+/**
+ * Hash the given pid - multiplicative hashing spreads the dense pid
+ * sequences produced by the kernel over the whole table
+ */
+static unsigned hash_pid(int pid, int size) {
+  return ((unsigned)pid * 2654435761U) & (size - 1);
+}
+
+
+/**
+ * Insert the process tree entry at the given index to the hash
+ */
+static void index_insert(ProcessIndex_T *I, int entry) {
+  unsigned h;
+
+  /* Keep the load factor below 1/2 */
+  if (2 * (I->used + 1) > I->size) {
+    int  i;
+    int  oldsize = I->size;
+    int *oldslot = I->slot;
+
+    for (I->size = I->size ? I->size : 64; 2 * (I->used + 1) > I->size; I->size <<= 1);
+    I->slot = xcalloc(sizeof(int), I->size);
+    I->used = 0;
+    for (i = 0; i < oldsize; i++)
+      if (oldslot[i])
+        index_insert(I, oldslot[i] - 1);
+    FREE(oldslot);
+  }
+
+  for (h = hash_pid(I->pt[entry].pid, I->size); I->slot[h]; h = (h + 1) & (I->size - 1));
+  I->slot[h] = entry + 1;
+  I->used++;
+}
+
+
+/**
+ * Remove the process tree entry at the given index from the hash. The
+ * entries following in the probe sequence are shifted back, so the
+ * lookup doesn't need tombstones.
+ */
+static void index_remove(ProcessIndex_T *I, int entry) {
+  unsigned h, j, k;
+  unsigned mask = I->size - 1;
+
+  for (h = hash_pid(I->pt[entry].pid, I->size); I->slot[h] != entry + 1; h = (h + 1) & mask)
+    if (! I->slot[h])
+      return;
+  I->slot[h] = 0;
+  I->used--;
+
+  for (j = (h + 1) & mask; I->slot[j]; j = (j + 1) & mask) {
+    k = hash_pid(I->pt[I->slot[j] - 1].pid, I->size);
+    /* Move the entry to the hole unless its home slot lies cyclically in (h, j] */
+    if ((h < j) ? (k <= h || k > j) : (k <= h && k > j)) {
+      I->slot[h] = I->slot[j];
+      I->slot[j] = 0;
+      h = j;
+    }
+  }
+}
+
+
+/**
+ * Build the hash for the whole process tree
+ */
+static void index_build(ProcessIndex_T *I, ProcessTree_T *pt, int size) {
+  int i;
+
+  FREE(I->slot);
+  I->pt   = pt;
+  I->used = 0;
+  for (I->size = 64; I->size < 2 * size; I->size <<= 1);
+  I->slot = xcalloc(sizeof(int), I->size);
+  for (i = 0; i < size; i++)
+    if (pt[i].pid != SLOT_FREE)
+      index_insert(I, i);
+}
+
+
+/**
+ * Lookup the process tree index of the given pid
+ * @return process index if found otherwise -1
+ */
+static int index_lookup(ProcessIndex_T *I, int pid) {
+  unsigned h;
+
+  if (! I->slot)
+    return -1;
+  for (h = hash_pid(pid, I->size); I->slot[h]; h = (h + 1) & (I->size - 1))
+    if (I->pt[I->slot[h] - 1].pid == pid)
+      return I->slot[h] - 1;
+  return -1;
+}
+
+
+/**
+ * Drop the hash
+ */
+static void index_free(ProcessIndex_T *I) {
+  FREE(I->slot);
+  I->pt   = NULL;
+  I->size = 0;
+  I->used = 0;
+}
+
+
+/**
+ * Get an unused process tree slot for the given pid. Slots of exited
+ * processes are recycled, the tree grows only if none is available.
+ * @return index of the slot
+ */
+static int slot_get(ProcessTree_T **pt_r, int *size_r, int pid) {
+  int i;
+
+  if (slots.freenum) {
+    i = slots.free[--slots.freenum];
+  } else {
+    if (*size_r == slots.capacity) {
+      slots.capacity = slots.capacity ? 2 * slots.capacity : 256;
+      *pt_r = xresize(*pt_r, slots.capacity * sizeof(ProcessTree_T));
+      slots.index.pt = *pt_r;
+    }
+    i = (*size_r)++;
+  }
+  memset(&(*pt_r)[i], 0, sizeof(ProcessTree_T));
+  (*pt_r)[i].pid = pid;
+  index_insert(&slots.index, i);
+  return i;
+}
+
+
+/**
+ * Release the process tree slot of an exited process
+ */
+static void slot_release(ProcessTree_T *pt, int i) {
+  index_remove(&slots.index, i);
+  FREE(pt[i].cmdline);
+  pt[i].pid = pt[i].ppid = SLOT_FREE;
+  if (slots.freenum == slots.freesize) {
+    slots.freesize = slots.freesize ? 2 * slots.freesize : 256;
+    slots.free = xresize(slots.free, slots.freesize * sizeof(int));
+  }
+  slots.free[slots.freenum++] = i;
+}
+
+
+/**
+ * Move the used slots to the beginning of the tree if most of the
+ * slots are unused, e.g. after a burst of short living processes
+ */
+static void slot_compact(ProcessTree_T *pt, int *size_r) {
+  int i, j;
+
+  if (*size_r < SLOT_COMPACT_MIN || 2 * slots.freenum < *size_r)
+    return;
+  for (i = j = 0; i < *size_r; i++)
+    if (pt[i].pid != SLOT_FREE)
+      pt[j++] = pt[i];
+  *size_r = j;
+  slots.freenum = 0;
+  index_build(&slots.index, pt, *size_r);
+}
+
+
+/**
+ * Update the process tree slot with the data of the process found by
+ * the system dependent scan. The CPU usage is computed from the values
+ * collected by the previous cycle if the slot holds the same process
+ * instance.
+ */
+static void slot_update(ProcessTree_T *pt, int i, ProcessTree_T *scanned) {
+  ProcessTree_T *p = &pt[i];
+
+  if (p->starttime == scanned->starttime && p->time) {
+    scanned->cputime_prev = p->cputime;
+    scanned->time_prev    = p->time;
+
+    /* The cpu_percent may be set already (for example by HPUX module) */
+    if (scanned->cpu_percent == 0 && scanned->cputime_prev != 0 && scanned->cputime != 0 && scanned->cputime > scanned->cputime_prev) {
+      scanned->cpu_percent = (int)((1000 * (double)(scanned->cputime - scanned->cputime_prev) / (scanned->time - scanned->time_prev)) / systeminfo.cpus);
+      if (scanned->cpu_percent > 1000 / systeminfo.cpus)
+        scanned->cpu_percent = 1000 / systeminfo.cpus;
+    }
+
+    /* Keep the command line if the system dependent code did not read it again */
+    if (! scanned->cmdline) {
+      scanned->cmdline = p->cmdline;
+      p->cmdline = NULL;
+    }
+  } else {
+    scanned->cputime_prev = 0;
+    scanned->time_prev    = 0.0;
+    scanned->cpu_percent  = 0;
+  }
+
+  FREE(p->cmdline);
+  *p = *scanned;
+  p->seen = slots.cycle;
+}
+
+
+/**
+ * Connect the processes in the tree with their parents. The children
+ * indexes of all processes are stored in one shared array, grouped by
+ * the parent process, so no per process allocation is needed.
+ */
+static void linkprocesstree(ProcessTree_T *pt, int size, int **children_r, int *childrensize_r) {
+  int i;
+  int n = 0;
+
+  for (i = 0; i < size; i++) {
+    pt[i].visited      = 0;
+    pt[i].children_num = 0;
+    pt[i].children     = NULL;
+  }
+
+  /* The parent may follow its children in the tree */
+  for (i = 0; i < size; i++) {
+    if (pt[i].pid == SLOT_FREE) {
+      pt[i].parent = -1;
+    } else if (pt[i].pid == pt[i].ppid) {
+      pt[i].parent = i;
+    } else {
+      pt[i].parent = index_lookup(&slots.index, pt[i].ppid);
+      pt[pt[i].parent].children_num++;
+      n++;
+    }
+  }
+
+  if (n > *childrensize_r) {
+    *childrensize_r = n;
+    *children_r = xresize(*children_r, n * sizeof(int));
+  }
+
+  /* Reserve the children ranges, then fill them */
+  for (i = 0, n = 0; i < size; i++) {
+    pt[i].children = *children_r + n;
+    n += pt[i].children_num;
+    pt[i].children_num = 0;
+  }
+  for (i = 0; i < size; i++)
+    if (pt[i].parent != -1 && pt[i].parent != i) {
+      ProcessTree_T *parent = &pt[pt[i].parent];
+      parent->children[parent->children_num++] = i;
+    }
+}
+
+
+/**
+ * Get the longest literal text which every string matching the given
+ * extended regular expression must contain. The parsing is
+ * conservative - anything not understood just ends the literal.
+ * @param regex The regular expression
+ * @return The literal text (to be freed by the caller) or NULL
+ */
+static char *processliteral(const char *regex) {
+  int         best = 0;
+  int         length = 0;
+  char       *literal;
+  char       *current;
+  const char *r = regex;
+
+  /* An alternative would need a literal for each branch */
+  if (strchr(regex, '|'))
+    return NULL;
+
+  literal = xcalloc(sizeof(char), strlen(regex) + 1);
+  current = xcalloc(sizeof(char), strlen(regex) + 1);
+  while (*r) {
+    int c;
+
+    if (*r == '\\' && r[1] && strchr("^.[]$()|*+?{}\\", r[1])) {
+      c = (unsigned char)r[1];
+      r += 2;
+    } else if (*r == '[') {
+      /* Bracket expression: "]" right after the opening "[" or "[^" is a member */
+      r++;
+      if (*r == '^')
+        r++;
+      if (*r == ']')
+        r++;
+      for (; *r && *r != ']'; r++)
+        if (*r == '[' && (r[1] == ':' || r[1] == '.' || r[1] == '=')) {
+          char close = r[1];
+          for (r += 2; *r && ! (*r == close && r[1] == ']'); r++);
+          if (*r)
+            r++;
+        }
+      if (*r)
+        r++;
+      c = -1;
+    } else if (*r == '(') {
+      int depth = 0;
+
+      /* The group may be optional, skip it */
+      for (; *r; r++) {
+        if (*r == '\\' && r[1])
+          r++;
+        else if (*r == '(')
+          depth++;
+        else if (*r == ')' && --depth == 0)
+          break;
+      }
+      if (*r)
+        r++;
+      c = -1;
+    } else if (*r == '{') {
+      for (; *r && *r != '}'; r++);
+      if (*r)
+        r++;
+      c = -1;
+    } else if (*r == '\\' || strchr("^$.*+?)", *r)) {
+      r += r[1] && *r == '\\' ? 2 : 1;
+      c = -1;
+    } else {
+      c = (unsigned char)*r++;
+    }
+
+    /* The character followed by "*", "?" or an interval may be missing in the match */
+    if (c != -1 && (*r == '*' || *r == '?' || *r == '{'))
+      c = -1;
+    if (c != -1)
+      current[length++] = c;
+    if (c == -1 || *r == '+') {
+      if (length > best) {
+        best = length;
+        memcpy(literal, current, length);
+        literal[length] = 0;
+      }
+      length = 0;
+    }
+  }
+  if (length > best) {
+    best = length;
+    memcpy(literal, current, length);
+    literal[length] = 0;
+  }
+  FREE(current);
+  if (! best)
+    FREE(literal);
+  return literal;
+}
+
+
+/**
+ * Get the automaton node reached from the given node by the given
+ * character in the trie
+ * @return The node or -1 if there is no such edge
+ */
+static int matcher_goto(ProcessMatcher_T *M, int node, unsigned char c) {
+  int e;
+
+  for (e = M->node[node].edge; e != -1; e = M->edge[e].next)
+    if (M->edge[e].c == c)
+      return M->edge[e].node;
+  return -1;
+}
+
+
+/**
+ * Add a new automaton node
+ * @return The node index
+ */
+static int matcher_newnode(ProcessMatcher_T *M) {
+  M->node = xresize(M->node, (M->nodecount + 1) * sizeof(ProcessMatchNode_T));
+  M->node[M->nodecount].edge   = -1;
+  M->node[M->nodecount].fail   = 0;
+  M->node[M->nodecount].output = -1;
+  M->node[M->nodecount].dict   = -1;
+  return M->nodecount++;
+}
+
+
+/**
+ * Add the match pattern to the matcher. The literal which the pattern
+ * requires is inserted into the prefilter trie, the pattern without
+ * such literal is tested against every command line.
+ */
+static void matcher_add(ProcessMatcher_T *M, Match_T m, Service_T s) {
+  int               node = 0;
+  unsigned char    *c;
+  ProcessPattern_T *p;
+
+  M->pattern = xresize(M->pattern, (M->count + 1) * sizeof(ProcessPattern_T));
+  p = &M->pattern[M->count];
+  memset(p, 0, sizeof(ProcessPattern_T));
+  p->match    = m;
+  p->service  = s;
+  p->found    = -1;
+  p->samenext = -1;
+#ifdef HAVE_REGEX_H
+  p->literal  = processliteral(m->match_string);
+#else
+  p->literal  = *m->match_string ? xstrdup(m->match_string) : NULL;
+#endif
+
+  if (! p->literal) {
+    M->scan = xresize(M->scan, (M->scancount + 1) * sizeof(int));
+    M->scan[M->scancount++] = M->count++;
+    return;
+  }
+
+  if (! M->nodecount)
+    matcher_newnode(M);
+  for (c = (unsigned char *)p->literal; *c; c++) {
+    int next = matcher_goto(M, node, *c);
+
+    if (next == -1) {
+      next = matcher_newnode(M);
+      M->edge = xresize(M->edge, (M->edgecount + 1) * sizeof(ProcessMatchEdge_T));
+      M->edge[M->edgecount].c    = *c;
+      M->edge[M->edgecount].node = next;
+      M->edge[M->edgecount].next = M->node[node].edge;
+      M->node[node].edge = M->edgecount++;
+    }
+    node = next;
+  }
+  p->samenext = M->node[node].output;
+  M->node[node].output = M->count++;
+}
+
+
+/**
+ * Compute the automaton fail and dictionary links breadth first
+ */
+static void matcher_compile(ProcessMatcher_T *M) {
+  int  head;
+  int  tail = 0;
+  int *queue;
+
+  if (! M->nodecount)
+    return;
+  queue = xcalloc(sizeof(int), M->nodecount);
+  queue[tail++] = 0;
+  for (head = 0; head < tail; head++) {
+    int e;
+    int node = queue[head];
+
+    for (e = M->node[node].edge; e != -1; e = M->edge[e].next) {
+      int child = M->edge[e].node;
+      int fail  = M->node[node].fail;
+
+      if (node) {
+        int next;
+        while ((next = matcher_goto(M, fail, M->edge[e].c)) == -1 && fail)
+          fail = M->node[fail].fail;
+        M->node[child].fail = (next == -1) ? 0 : next;
+      } else {
+        M->node[child].fail = 0;
+      }
+      fail = M->node[child].fail;
+      M->node[child].dict = (M->node[fail].output != -1) ? fail : M->node[fail].dict;
+      queue[tail++] = child;
+    }
+  }
+  FREE(queue);
+}
+
+
+/**
+ * Test the pattern against the command line unless it was tested
+ * already or has a match
+ */
+static void matcher_test(ProcessMatcher_T *M, int pattern, const char *cmdline, int index) {
+  ProcessPattern_T *p = &M->pattern[pattern];
+
+  if (p->found != -1 || p->stamp == M->stamp)
+    return;
+  p->stamp = M->stamp;
+#ifdef HAVE_REGEX_H
+  if (regexec(p->match->regex_comp, cmdline, 0, NULL, 0))
+    return;
+#endif
+  p->found = index;
+  M->open--;
+}
+
+
+/**
+ * Test the command line of the process at the given tree index against
+ * the patterns without a match. The literal prefilter selects the
+ * patterns which may match, only these are evaluated.
+ */
+static void matcher_match(ProcessMatcher_T *M, const char *cmdline, int index) {
+  int                  i;
+  int                  node = 0;
+  const unsigned char *c;
+
+  M->stamp++;
+  if (M->nodecount) {
+    for (c = (const unsigned char *)cmdline; *c && M->open; c++) {
+      int n, next;
+
+      while ((next = matcher_goto(M, node, *c)) == -1 && node)
+        node = M->node[node].fail;
+      node = (next == -1) ? 0 : next;
+      for (n = (M->node[node].output != -1) ? node : M->node[node].dict; n != -1; n = M->node[n].dict)
+        for (i = M->node[n].output; i != -1; i = M->pattern[i].samenext)
+          matcher_test(M, i, cmdline, index);
+    }
+  }
+  for (i = 0; i < M->scancount && M->open; i++)
+    matcher_test(M, M->scan[i], cmdline, index);
+}
+
+
+/**
+ * Free the matcher
+ */
+static void matcher_free(ProcessMatcher_T *M) {
+  int i;
+
+  for (i = 0; i < M->count; i++)
+    FREE(M->pattern[i].literal);
+  FREE(M->pattern);
+  FREE(M->scan);
+  FREE(M->node);
+  FREE(M->edge);
+  memset(M, 0, sizeof(ProcessMatcher_T));
+}
+
+
+/**
+ * Resolve the matching process of every process service using the
+ * "matching" statement. The process matched last time is kept while it
+ * runs and its command line matches, so the service sticks to the same
+ * process if several match. The first matching process is resolved for
+ * the other services by one pass over the process tree.
+ */
+static void matchprocesstree(ProcessTree_T *pt, int size) {
+  int i;
+
+  if (! matcher.count)
+    return;
+  matcher.open = matcher.count;
+  matcher.stamp++;
+  for (i = 0; i < matcher.count; i++) {
+    int               j;
+    ProcessPattern_T *p = &matcher.pattern[i];
+
+    p->found = -1;
+    if (p->pid && (j = index_lookup(&slots.index, p->pid)) != -1 && pt[j].starttime == p->starttime && pt[j].cmdline)
+      matcher_test(&matcher, i, pt[j].cmdline, j);
+  }
+  for (i = 0; i < size && matcher.open; i++)
+    if (pt[i].pid != SLOT_FREE && pt[i].cmdline)
+      matcher_match(&matcher, pt[i].cmdline, i);
+  for (i = 0; i < matcher.count; i++) {
+    ProcessPattern_T *p = &matcher.pattern[i];
+
+    p->pid       = (p->found != -1) ? pt[p->found].pid : 0;
+    p->starttime = (p->found != -1) ? pt[p->found].starttime : 0;
+    p->service->matchpid = p->pid;
+  }
+}
+
+
+#ifdef SYS_pidfd_open
+/**
+ * Close the descriptors of processes which are no longer watched. The
+ * descriptors are closed only by the watcher thread, so none of them
+ * is closed while the thread polls it.
+ */
+static void processwatch_close() {
+  int i;
+
+  for (i = 0; i < watcher.closedcount; i++)
+    close(watcher.closed[i]);
+  watcher.closedcount = 0;
+}
+
+
+/**
+ * Queue the descriptor to be closed by the watcher thread
+ */
+static void processwatch_release(int fd) {
+  watcher.closed = xresize(watcher.closed, (watcher.closedcount + 1) * sizeof(int));
+  watcher.closed[watcher.closedcount++] = fd;
+}
+
+
+/**
+ * The process exit watcher thread. The process descriptor becomes
+ * readable when the process exits - the service is flagged and the
+ * monit daemon is woken up to validate it without waiting for its next
+ * check.
+ */
+static void *processwatch(void *args) {
+  sigset_t       ns;
+  int            i, n;
+  struct pollfd *fds = NULL;
+
+  set_signal_block(&ns, NULL);
+  while (watcher.running) {
+    int exited = FALSE;
+
+    LOCK(watcherMutex)
+    {
+      processwatch_close();
+      n = watcher.count + 1;
+      fds = xresize(fds, n * sizeof(struct pollfd));
+      fds[0].fd     = watcher.pipe[0];
+      fds[0].events = POLLIN;
+      for (i = 1; i < n; i++) {
+        fds[i].fd     = watcher.watch[i - 1].fd;
+        fds[i].events = POLLIN;
+      }
+    }
+    END_LOCK;
+
+    if (poll(fds, n, -1) == -1) {
+      if (errno == EINTR)
+        continue;
+      LogError("%s: process exit watcher failed -- %s\n", prog, STRERROR);
+      break;
+    }
+
+    if (fds[0].revents) {
+      char buf[64];
+      if (read(watcher.pipe[0], buf, sizeof(buf)) < 0 && errno != EAGAIN)
+        DEBUG("process exit watcher wakeup read failed -- %s\n", STRERROR);
+    }
+
+    LOCK(watcherMutex)
+    {
+      for (i = 1; i < n; i++) {
+        int j;
+
+        if (! fds[i].revents)
+          continue;
+        for (j = 0; j < watcher.count; j++) {
+          if (watcher.watch[j].fd == fds[i].fd) {
+            DEBUG("'%s' process with pid %d exited\n", watcher.watch[j].service->name, watcher.watch[j].pid);
+            watcher.watch[j].service->exited = TRUE;
+            processwatch_release(watcher.watch[j].fd);
+            watcher.watch[j] = watcher.watch[--watcher.count];
+            exited = TRUE;
+            break;
+          }
+        }
+      }
+    }
+    END_LOCK;
+
+    if (exited) {
+      Run.doprocessexit = TRUE;
+      Schedule_notify();
+    }
+  }
+  FREE(fds);
+  return NULL;
+}
+#endif
+
+
+#ifdef HAVE_CGROUP
+/**
+ * Replace the process tree totals of the service by the usage of its
+ * cgroup. The cgroup accounts all processes started by the service,
+ * including double-forked helpers which left the process tree, and
+ * reading it doesn't depend on the process tree size. The cgroup path
+ * is looked up again when the process pid changes.
+ * @param s A process service with cgroup accounting
+ * @return TRUE if succeeded otherwise FALSE
+ */
+static int update_cgroup_data(Service_T s) {
+  char          path[STRLEN];
+  double        now = get_float_time();
+  Cgroup_T      cg = s->cgroup;
+  CgroupUsage_T u;
+
+  if (! cg->path && cg->pid != s->inf->priv.process.pid) {
+    FREE(cg->current);
+    if (get_cgroup_sysdep(s->inf->priv.process.pid, path, sizeof(path)))
+      cg->current = xstrdup(path);
+    cg->pid  = s->inf->priv.process.pid;
+    cg->time = 0;
+  } else if (cg->path && ! cg->current) {
+    cg->current = xstrdup(cg->path);
+  }
+  if (! cg->current) {
+    DEBUG("'%s' cgroup statistic error -- cannot find the cgroup of process %d\n", s->name, s->inf->priv.process.pid);
+    return FALSE;
+  }
+  if (! used_cgroup_sysdep(cg->current, &u)) {
+    LogError("'%s' cgroup statistic error -- cannot read cgroup %s\n", s->name, cg->current);
+    cg->time = 0;
+    return FALSE;
+  }
+
+  s->inf->priv.process.total_mem_kbyte   = (long)(u.mem_bytes / 1024);
+  s->inf->priv.process.total_mem_percent = (int)((double)s->inf->priv.process.total_mem_kbyte * 1000.0 / systeminfo.mem_kbyte_max);
+  if (cg->time > 0 && now > cg->time && u.cpu_usec >= cg->cpu_usec) {
+    /* get_float_time() counts tenths of a second */
+    double interval = (now - cg->time) / 10.0;
+
+    s->inf->priv.process.total_cpu_percent = (int)((100.0 * (u.cpu_usec - cg->cpu_usec) / 1000000.0 / interval) * 10.0 / systeminfo.cpus);
+    if (s->inf->priv.process.total_cpu_percent > 1000)
+      s->inf->priv.process.total_cpu_percent = 1000;
+    cg->read_rate  = u.io_read >= cg->io_read ? (long)((u.io_read - cg->io_read) / interval) : -1;
+    cg->write_rate = u.io_write >= cg->io_write ? (long)((u.io_write - cg->io_write) / interval) : -1;
+  } else {
+    s->inf->priv.process.total_cpu_percent = 0;
+    cg->read_rate  = -1;
+    cg->write_rate = -1;
+  }
+  cg->cpu_usec = u.cpu_usec;
+  cg->io_read  = u.io_read;
+  cg->io_write = u.io_write;
+  cg->time     = now;
+
+  return TRUE;
+}
+#endif
+
+
 /* ------------------------------------------------------------------ Public */
 
 
@@ -81,6 +931,9 @@
  * @return TRUE if succeeded otherwise FALSE.
  */
 int init_process_info(void) {
+  int i;
+
+  delprocessinfo();
   memset(&systeminfo, 0, sizeof(SystemInfo_T));
   gettimeofday(&systeminfo.collected, NULL);
   if(uname(&systeminfo.uname) < 0) {
@@ -91,12 +944,29 @@ int init_process_info(void) {
   systeminfo.total_cpu_user_percent = -10;
   systeminfo.total_cpu_syst_percent = -10;
   systeminfo.total_cpu_wait_percent = -10;
+  systeminfo.total_cpu_irq_percent = -10;
+  systeminfo.total_cpu_steal_percent = -10;
+  systeminfo.cpu_max_percent = -10;
+  for (i = 0; i < PRESSURE_COUNT; i++)
+    systeminfo.pressure[i] = -10;
 
   return (init_process_info_sysdep());
 
 }
 
 
+/**
+ * Free the system information collected since init_process_info(), the
+ * per-CPU usage is rebuilt on the next update
+ */
+void delprocessinfo(void) {
+  FREE(systeminfo.cpu_percent);
+  systeminfo.cpu_count       = 0;
+  systeminfo.cpu_max         = 0;
+  systeminfo.cpu_max_percent = -10;
+}
+
+
 /**
  * Get the proc infomation (CPU percentage, MEM in MByte and percent,
  * status), enduser version. 
@@ -135,6 +1005,11 @@ int update_process_data(Service_T s, ProcessTree_T *pt, int treesize, pid_t pid)
       s->inf->priv.process.mem_percent       = (int)((double)pt[leaf].mem_kbyte * 1000.0 / systeminfo.mem_kbyte_max);
     }
 
+#ifdef HAVE_CGROUP
+    if (s->cgroup)
+      update_cgroup_data(s);
+#endif
+
   } else {
     s->inf->priv.process.ppid              = 0;
     s->inf->priv.process.uptime            = 0;
@@ -181,6 +1056,11 @@ int update_system_load(ProcessTree_T *pt, int treesize) {
       goto error3;
     }
 
+#ifdef HAVE_PRESSURE
+    /** Get pressure stall statistic, older kernels don't provide it */
+    used_system_pressure_sysdep(&systeminfo);
+#endif
+
     return TRUE;
   }
 
@@ -195,30 +1075,30 @@ error3:
   systeminfo.total_cpu_user_percent = 0;
   systeminfo.total_cpu_syst_percent = 0;  
   systeminfo.total_cpu_wait_percent = 0;  
+  systeminfo.total_cpu_irq_percent = 0;  
+  systeminfo.total_cpu_steal_percent = 0;  
+  systeminfo.cpu_max_percent = 0;  
 
   return FALSE;
 }
 
 
 /**
- * Initialize the process tree 
+ * Initialize the process tree. The tree is kept across cycles, entries
+ * of running processes are updated in place and slots of processes
+ * which exited are reused.
  * @return treesize >= 0 if succeeded otherwise < 0
  */
-int initprocesstree(ProcessTree_T **pt_r, int *size_r, ProcessTree_T **oldpt_r, int *oldsize_r) {
+int initprocesstree(ProcessTree_T **pt_r, int *size_r) {
   int i;
-  int oldentry;
-  ProcessTree_T *pt;
-  ProcessTree_T *oldpt;
+  int n;
   int root = -1;
+  ProcessTree_T *pt;
+  ProcessTree_T *scanned;
+  struct timeval start, stop;
 
-  if (*pt_r != NULL) {  
-    if (oldpt_r && *oldpt_r != NULL)
-      delprocesstree(oldpt_r, oldsize_r);
-    *oldpt_r   = *pt_r; 
-    *oldsize_r = *size_r; 
-  }
-  
-  if ((*size_r = initprocesstree_sysdep(pt_r)) <= 0) {
+  gettimeofday(&start, NULL);
+  if ((n = initprocesstree_sysdep(&slots.scan)) <= 0) {
     DEBUG("system statistic error -- cannot initialize the process tree => process resource monitoring disabled\n");
     Run.doprocess = FALSE;
     return -1;
@@ -227,56 +1107,59 @@ int initprocesstree(ProcessTree_T **pt_r, int *size_r, ProcessTree_T **oldpt_r,
     Run.doprocess = TRUE;
   }
 
-  pt    = *pt_r;
-  oldpt = *oldpt_r;
+  if (*pt_r == NULL) {
+    slots.capacity = 0;
+    slots.freenum  = 0;
+  }
+  slots.index.pt = *pt_r;
+  slots.cycle++;
 
-  if (pt == NULL)
-    return 0;
+  /* Merge the scanned processes - the command line ownership moves to the tree */
+  scanned = slots.scan;
+  for (i = 0; i < n; i++) {
+    int j = index_lookup(&slots.index, scanned[i].pid);
 
-  for (i = 0; i < (volatile int)*size_r; i ++) {
-    if (oldpt && ((oldentry = findprocess(pt[i].pid, oldpt, *oldsize_r)) != -1)) {
-      pt[i].cputime_prev = oldpt[oldentry].cputime;
-      pt[i].time_prev    = oldpt[oldentry].time;
- 
-      /* The cpu_percent may be set already (for example by HPUX module) */
-      if (pt[i].cpu_percent  == 0 && pt[i].cputime_prev != 0 && pt[i].cputime != 0 && pt[i].cputime > pt[i].cputime_prev) {
-        pt[i].cpu_percent = (int)((1000 * (double)(pt[i].cputime - pt[i].cputime_prev) / (pt[i].time - pt[i].time_prev)) / systeminfo.cpus);
-        if (pt[i].cpu_percent > 1000 / systeminfo.cpus)
-          pt[i].cpu_percent = 1000 / systeminfo.cpus;
-      }
-    } else {
-      pt[i].cputime_prev = 0;
-      pt[i].time_prev    = 0.0;
-      pt[i].cpu_percent  = 0;
-    }
-        
-    if (pt[i].pid == pt[i].ppid) {
-      pt[i].parent = i;
-      continue;
-    }
+    if (j == -1)
+      j = slot_get(pt_r, size_r, scanned[i].pid);
+    slot_update(*pt_r, j, &scanned[i]);
+  }
 
-    if ((pt[i].parent = findprocess(pt[i].ppid, pt, *size_r)) == -1) {
-      /* Parent process wasn't found - on Linux this is normal: main process with PID 0 is not listed, similarly in FreeBSD jail.
-       * We create virtual process entry for missing parent so we can have full tree-like structure with root. */
-      int j = (*size_r)++;
+  /* Keep the parents. If the parent process wasn't found - on Linux this is normal: main process with PID 0 is not listed, similarly in
+   * FreeBSD jail - we create virtual process entry for missing parent so we can have full tree-like structure with root. */
+  for (i = 0; i < *size_r; i++) {
+    int j;
 
-      pt = *pt_r = xresize(*pt_r, *size_r * sizeof(ProcessTree_T));
+    pt = *pt_r;
+    if (pt[i].pid == SLOT_FREE || pt[i].seen != slots.cycle || pt[i].pid == pt[i].ppid)
+      continue;
+    if ((j = index_lookup(&slots.index, pt[i].ppid)) == -1) {
+      j = slot_get(pt_r, size_r, pt[i].ppid);
+      pt = *pt_r;
+    } else if (pt[j].seen != slots.cycle) {
+      /* The slot of the previous cycle is reused as the virtual parent */
+      FREE(pt[j].cmdline);
       memset(&pt[j], 0, sizeof(ProcessTree_T));
-      pt[j].ppid = pt[j].pid  = pt[i].ppid;
-      pt[i].parent = j;
-    }
-    
-    if (! connectchild(pt, pt[i].parent, i)) {
-      /* connection to parent process has failed, this is usually caused in the part above */
-      DEBUG("system statistic error -- cannot connect process id %d to its parent %d\n", pt[i].pid, pt[i].ppid);
-      pt[i].pid = 0;
+      pt[j].pid = pt[i].ppid;
+    } else {
       continue;
     }
+    pt[j].ppid = pt[j].pid;
+    pt[j].seen = slots.cycle;
   }
 
+  /* Release the slots of processes which exited */
+  pt = *pt_r;
+  for (i = 0; i < *size_r; i++)
+    if (pt[i].pid != SLOT_FREE && pt[i].seen != slots.cycle)
+      slot_release(pt, i);
+  slot_compact(pt, size_r);
+
+  linkprocesstree(pt, *size_r, &slots.children, &slots.childrensize);
+  matchprocesstree(pt, *size_r);
+
   /* The main process in Solaris zones and FreeBSD host doesn't have pid 1, so try to find process which is parent of itself */
   for (i = 0; i < *size_r; i++) {
-    if (pt[i].pid == pt[i].ppid) {
+    if (pt[i].pid != SLOT_FREE && pt[i].pid == pt[i].ppid) {
       root = i;
       break;
     }
@@ -287,7 +1170,11 @@ int initprocesstree(ProcessTree_T **pt_r, int *size_r, ProcessTree_T **oldpt_r,
     return -1;
   }
 
-  fillprocesstree(pt, root);
+  fillprocesstree(pt, root, *size_r, &slots.aggregate);
+
+  gettimeofday(&stop, NULL);
+  DEBUG("system statistic -- process table of %d processes read in %.3f ms\n", n, (stop.tv_sec - start.tv_sec) * 1000. + (stop.tv_usec - start.tv_usec) / 1000.);
+
   update_system_load(*pt_r, *size_r);
 
   return *size_r;
@@ -295,7 +1182,9 @@ int initprocesstree(ProcessTree_T **pt_r, int *size_r, ProcessTree_T **oldpt_r,
 
 
 /**
- * Search a leaf in the processtree
+ * Search a leaf in the processtree. The process tree maintained by
+ * initprocesstree() is hash indexed, other trees are searched
+ * sequentially.
  * @param pid  pid of the process
  * @param pt  processtree
  * @param treesize  size of the processtree
@@ -309,6 +1198,9 @@ int findprocess(int pid, ProcessTree_T *pt, int size) {
   if (size <= 0)
     return -1;
 
+  if (pt == slots.index.pt)
+    return index_lookup(&slots.index, pid);
+
   for (i = 0; i < size; i++)
     if (pid == pt[i].pid)
       return i;
@@ -316,6 +1208,27 @@ int findprocess(int pid, ProcessTree_T *pt, int size) {
   return -1;
 }
 
+
+/**
+ * Test whether the process tree holds the command line of the given
+ * process instance. The process command line rarely changes, so the
+ * system dependent code doesn't need to read it again if the pid and
+ * the start time of the process are unchanged - initprocesstree() keeps
+ * the command line in the tree if none was read.
+ * @param pid  pid of the process
+ * @param starttime  start time of the process
+ * @return TRUE if the command line can be reused, otherwise FALSE
+ */
+int hasprocesscmdline(int pid, time_t starttime) {
+  int            i;
+  ProcessTree_T *pt = slots.index.pt;
+
+  if ((i = index_lookup(&slots.index, pid)) == -1 || ! pt[i].cmdline)
+    return FALSE;
+  return pt[i].starttime == starttime && pt[i].time / 10. - pt[i].starttime >= CMDLINE_SETTLE_TIME;
+}
+
+
 /**
  * Delete the process tree 
  */
@@ -325,10 +1238,16 @@ void delprocesstree(ProcessTree_T **reference, int *size) {
 
   if (pt == NULL || size <= 0)
       return;
-  for (i = 0; i < *size; i++) {
-    FREE(pt[i].cmdline);
-    FREE(pt[i].children);
+  if (pt == slots.index.pt) {
+    index_free(&slots.index);
+    FREE(slots.free);
+    FREE(slots.children);
+    freeprocessaggregate(&slots.aggregate);
+    FREE(slots.scan);
+    memset(&slots, 0, sizeof(slots));
   }
+  for (i = 0; i < *size; i++)
+    FREE(pt[i].cmdline);
   FREE(pt);
   *reference = NULL;
   *size = 0;
@@ -337,36 +1256,40 @@ void delprocesstree(ProcessTree_T **reference, int *size) {
 
 
 void process_testmatch(char *pattern) {
+  struct mymatch   m;
+  ProcessMatcher_T M;
 #ifdef HAVE_REGEX_H
-  regex_t *regex_comp;
-  int reg_return;
+  int              reg_return;
 #endif
 
+  memset(&m, 0, sizeof(m));
+  memset(&M, 0, sizeof(M));
+  m.match_string = pattern;
 #ifdef HAVE_REGEX_H
-  NEW(regex_comp);
-  if ((reg_return = regcomp(regex_comp, pattern, REG_NOSUB|REG_EXTENDED))) {
+  NEW(m.regex_comp);
+  if ((reg_return = regcomp(m.regex_comp, pattern, REG_NOSUB|REG_EXTENDED))) {
     char errbuf[STRLEN];
-    regerror(reg_return, regex_comp, errbuf, STRLEN);
-    regfree(regex_comp);
-    FREE(regex_comp);
+    regerror(reg_return, m.regex_comp, errbuf, STRLEN);
+    regfree(m.regex_comp);
+    FREE(m.regex_comp);
     printf("Regex %s parsing error: %s\n", pattern, errbuf);
     exit(1);
   }
 #endif
-  initprocesstree(&ptree, &ptreesize, &oldptree, &oldptreesize);
+  matcher_add(&M, &m, NULL);
+  matcher_compile(&M);
+  Run.doprocessmatch = TRUE;
+  initprocesstree(&ptree, &ptreesize);
   if (Run.doprocess) {
     int i, count = 0;
     printf("List of processes matching pattern \"%s\":\n", pattern);
     printf("------------------------------------------\n");
     for (i = 0; i < ptreesize; i++) {
-      int match = FALSE;
-      if (ptree[i].cmdline && ! strstr(ptree[i].cmdline, "procmatch")) {
-#ifdef HAVE_REGEX_H
-        match = regexec(regex_comp, ptree[i].cmdline, 0, NULL, 0) ? FALSE : TRUE;
-#else
-        match = strstr(ptree[i].cmdline, pattern) ? TRUE : FALSE;
-#endif
-        if (match) {
+      if (ptree[i].pid != SLOT_FREE && ptree[i].cmdline && ! strstr(ptree[i].cmdline, "procmatch")) {
+        M.open = 1;
+        M.pattern[0].found = -1;
+        matcher_match(&M, ptree[i].cmdline, i);
+        if (M.pattern[0].found != -1) {
           printf("\t%s\n", ptree[i].cmdline);
           count++;
         }
@@ -377,6 +1300,180 @@ void process_testmatch(char *pattern) {
     if (count > 1)
       printf("WARNING: multiple processes matched the pattern. The check is FIRST-MATCH based, please refine the pattern\n");
   }
+  matcher_free(&M);
+#ifdef HAVE_REGEX_H
+  regfree(m.regex_comp);
+  FREE(m.regex_comp);
+#endif
+}
+
+
+/**
+ * Compile the patterns of all process services using the "matching"
+ * statement into one matcher. The matching processes are then resolved
+ * for all services by one pass on each process tree update.
+ * @param list The service list
+ */
+void initprocessmatch(Service_T list) {
+  Service_T s;
+
+  matcher_free(&matcher);
+  for (s = list; s; s = s->next)
+    if (s->type == TYPE_PROCESS && s->matchlist)
+      matcher_add(&matcher, s->matchlist, s);
+  matcher_compile(&matcher);
+}
+
+
+/**
+ * Free the process matcher
+ */
+void delprocessmatch() {
+  matcher_free(&matcher);
+}
+
+
+
+
+/**
+ * Start the process exit watcher. The monitored processes are watched
+ * using pidfd on Linux, if it isn't available the process exit is
+ * detected by the next validation cycle as usual.
+ * @return TRUE if the watcher was started otherwise FALSE
+ */
+int initprocesswatch() {
+#ifdef SYS_pidfd_open
+  int fd;
+  int status;
+
+  if (watcher.running)
+    return TRUE;
+
+  /* Test that the kernel supports pidfd */
+  if ((fd = syscall(SYS_pidfd_open, getpid(), 0)) == -1) {
+    DEBUG("%s: process exit watcher not available -- %s\n", prog, STRERROR);
+    return FALSE;
+  }
+  close(fd);
+
+  if (pipe(watcher.pipe) == -1) {
+    LogError("%s: cannot create the process exit watcher pipe -- %s\n", prog, STRERROR);
+    return FALSE;
+  }
+  fcntl(watcher.pipe[0], F_SETFL, O_NONBLOCK);
+  fcntl(watcher.pipe[1], F_SETFL, O_NONBLOCK);
+  watcher.running = TRUE;
+  if ((status = pthread_create(&watcher.thread, NULL, processwatch, NULL)) != 0) {
+    LogError("%s: Failed to create the process exit watcher thread -- %s\n", prog, strerror(status));
+    watcher.running = FALSE;
+    close(watcher.pipe[0]);
+    close(watcher.pipe[1]);
+    return FALSE;
+  }
+  return TRUE;
+#else
+  return FALSE;
+#endif
 }
 
 
+/**
+ * Stop the process exit watcher and release the watched processes
+ */
+void delprocesswatch() {
+#ifdef SYS_pidfd_open
+  int i;
+  int status;
+
+  if (! watcher.running)
+    return;
+
+  watcher.running = FALSE;
+  if (write(watcher.pipe[1], "x", 1) < 0)
+    DEBUG("process exit watcher wakeup failed -- %s\n", STRERROR);
+  if ((status = pthread_join(watcher.thread, NULL)) != 0)
+    LogError("%s: Failed to stop the process exit watcher thread -- %s\n", prog, strerror(status));
+
+  processwatch_close();
+  for (i = 0; i < watcher.count; i++)
+    close(watcher.watch[i].fd);
+  close(watcher.pipe[0]);
+  close(watcher.pipe[1]);
+  FREE(watcher.watch);
+  FREE(watcher.closed);
+  memset(&watcher, 0, sizeof(watcher));
+#endif
+}
+
+
+/**
+ * Watch the service process for exit. The process watched for the
+ * service before is replaced if the pid differs.
+ * @param s The process service
+ * @param pid The process pid
+ */
+void watchprocess(Service_T s, int pid) {
+#ifdef SYS_pidfd_open
+  if (! watcher.running)
+    return;
+
+  LOCK(watcherMutex)
+  {
+    int i;
+    int fd = -1;
+
+    for (i = 0; i < watcher.count; i++)
+      if (watcher.watch[i].service == s)
+        break;
+    if (i == watcher.count || watcher.watch[i].pid != pid) {
+      if ((fd = syscall(SYS_pidfd_open, pid, 0)) == -1) {
+        DEBUG("'%s' cannot watch process with pid %d -- %s\n", s->name, pid, STRERROR);
+      } else {
+        if (i < watcher.count) {
+          processwatch_release(watcher.watch[i].fd);
+        } else {
+          watcher.watch = xresize(watcher.watch, (watcher.count + 1) * sizeof(ProcessWatch_T));
+          watcher.count++;
+        }
+        watcher.watch[i].service = s;
+        watcher.watch[i].pid     = pid;
+        watcher.watch[i].fd      = fd;
+        if (write(watcher.pipe[1], "x", 1) < 0 && errno != EAGAIN)
+          DEBUG("process exit watcher wakeup failed -- %s\n", STRERROR);
+      }
+    }
+  }
+  END_LOCK;
+#endif
+}
+
+
+/**
+ * Wait for the process exit. The process descriptor is polled if pidfd
+ * is available, otherwise the process is tested after the timeout.
+ * @param pid The process pid
+ * @param timeout Maximal time to wait [ms]
+ * @return TRUE if the process exited, otherwise FALSE
+ */
+int waitprocessexit(int pid, int timeout) {
+#ifdef SYS_pidfd_open
+  int fd;
+
+  if ((fd = syscall(SYS_pidfd_open, pid, 0)) != -1) {
+    int           rv;
+    struct pollfd pfd;
+
+    pfd.fd      = fd;
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
+    rv = poll(&pfd, 1, timeout);
+    close(fd);
+    return rv > 0;
+  } else if (errno == ESRCH) {
+    return TRUE;
+  }
+#endif
+  poll(NULL, 0, timeout);
+  errno = 0;
+  return ! ((getpgid(pid) > -1) || (errno == EPERM));
+}
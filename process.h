@@ -40,11 +40,18 @@
 
 int update_process_data(Service_T s, ProcessTree_T *, int treesize, pid_t pid);
 int init_process_info(void);
+void delprocessinfo(void);
 int update_system_load(ProcessTree_T *, int);
 int  findprocess(int, ProcessTree_T *, int);
-int  initprocesstree(ProcessTree_T **, int *, ProcessTree_T **, int *);
+int  initprocesstree(ProcessTree_T **, int *);
 void delprocesstree(ProcessTree_T **, int *);
 void process_testmatch(char *);
+void initprocessmatch(Service_T);
+void delprocessmatch(void);
+int  initprocesswatch(void);
+void delprocesswatch(void);
+void watchprocess(Service_T, int);
+int  waitprocessexit(int, int);
 
 #endif
 
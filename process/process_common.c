@@ -80,6 +80,23 @@
 #include "process_sysdep.h"
 
 
+/**
+ * Get the root of the proc filesystem. It is "/proc" unless the
+ * MONIT_PROCFS environment variable points to another directory, for
+ * example to a synthetic process table used for testing.
+ * @return the proc filesystem root path
+ */
+char *get_proc_root() {
+  static char *root = NULL;
+
+  if (! root) {
+    char *env = getenv("MONIT_PROCFS");
+    root = (env && *env) ? env : "/proc";
+  }
+  return root;
+}
+
+
 /**
  * Reads an process dependent entry or the proc filesystem
  * @param buf buffer to write to
@@ -99,9 +116,9 @@ int read_proc_file(char *buf, int buf_size, char *name, int pid, int *bytes_read
   ASSERT(name);
 
   if (pid < 0)
-    snprintf(filename, STRLEN, "/proc/%s", name);
+    snprintf(filename, STRLEN, "%s/%s", get_proc_root(), name);
   else
-    snprintf(filename, STRLEN, "/proc/%d/%s", pid, name);
+    snprintf(filename, STRLEN, "%s/%d/%s", get_proc_root(), pid, name);
     
   if ((fd = open(filename, O_RDONLY)) < 0) {
     DEBUG("%s: Cannot open proc file %s -- %s\n", prog, filename, STRERROR);
@@ -139,56 +156,100 @@ double get_float_time(void) {
 
 
 /**
- * Connects child and parent in a process tree
+ * Fill data in the process tree. The tree is walked breadth first from
+ * the root, which orders every parent before its children and places
+ * the children of each process next to each other. The sums are then
+ * aggregated bottom up in this order using packed arrays, so deep
+ * process chains don't need recursion. The arrays are kept by the
+ * caller across cycles and are only reallocated when the tree grows.
  * @param pt process tree
- * @param parent index
- * @param child index
- * @return TRUE if succeeded otherwise FALSE.
+ * @param root index of the root process
+ * @param size size of the process tree
+ * @param a the aggregation work arrays
  */
-int connectchild(ProcessTree_T *pt, int parent, int child) {
+void fillprocesstree(ProcessTree_T *pt, int root, int size, ProcessAggregate_T *a) {
+  int            i, j;
+  int            n = 1;
+  int           *order;
+  int           *first;
+  int           *children_sum;
+  int           *cpu_sum;
+  unsigned long *mem_sum;
 
   ASSERT(pt);
+  ASSERT(a);
+
+  if (size <= 0 || pt[root].visited == 1)
+    return;
+
+  if (size > a->size) {
+    a->order        = xresize(a->order, size * sizeof(int));
+    a->first        = xresize(a->first, size * sizeof(int));
+    a->children_sum = xresize(a->children_sum, size * sizeof(int));
+    a->cpu_sum      = xresize(a->cpu_sum, size * sizeof(int));
+    a->mem_sum      = xresize(a->mem_sum, size * sizeof(unsigned long));
+    a->size         = size;
+  }
+  order        = a->order;
+  first        = a->first;
+  children_sum = a->children_sum;
+  cpu_sum      = a->cpu_sum;
+  mem_sum      = a->mem_sum;
+
+  /* Topological order: the children of order[i] are at order[first[i]] .. order[first[i] + children_num - 1] */
+  order[0] = root;
+  pt[root].visited = 1;
+  for (i = 0; i < n; i++) {
+    ProcessTree_T *p = &pt[order[i]];
+
+    first[i] = n;
+    for (j = 0; j < p->children_num; j++) {
+      int child = p->children[j];
+      if (pt[child].visited == 1)
+        continue;
+      pt[child].visited = 1;
+      order[n++] = child;
+    }
+  }
 
-  if (pt[parent].pid == pt[child].pid)
-    return FALSE;
+  /* Aggregate the sums bottom up - the children are folded in their original order, the cpu sum is capped the same way as before */
+  for (i = n - 1; i >= 0; i--) {
+    ProcessTree_T *p   = &pt[order[i]];
+    int            end = (i + 1 < n) ? first[i + 1] : n;
+
+    children_sum[i] = p->children_num;
+    mem_sum[i]      = p->mem_kbyte;
+    cpu_sum[i]      = p->cpu_percent;
+    for (j = first[i]; j < end; j++) {
+      children_sum[i] += children_sum[j];
+      mem_sum[i]      += mem_sum[j];
+      cpu_sum[i]      += cpu_sum[j];
+      cpu_sum[i]       = (cpu_sum[j] > 1000) ? 1000 : cpu_sum[i];
+    }
+  }
 
-  pt[parent].children = xresize(pt[parent].children, sizeof(ProcessTree_T *) * (pt[parent].children_num + 1));
-  pt[parent].children[pt[parent].children_num] = child;
-  pt[parent].children_num++;
+  for (i = 0; i < n; i++) {
+    ProcessTree_T *p = &pt[order[i]];
 
-  return TRUE;
+    p->children_sum    = children_sum[i];
+    p->mem_kbyte_sum   = mem_sum[i];
+    p->cpu_percent_sum = cpu_sum[i];
+  }
 }
 
 
 /**
- * Fill data in the process tree by recusively walking through it
- * @param pt process tree
- * @param i process index
- * @return TRUE if succeeded otherwise FALSE.
+ * Free the process tree aggregation work arrays
+ * @param a the aggregation work arrays
  */
-void fillprocesstree(ProcessTree_T *pt, int index) {
-  int            i;
-  ProcessTree_T *parent_pt;
-
-  ASSERT(pt);
-
-  if (pt[index].visited == 1)
-    return;
-
-  pt[index].visited         = 1;
-  pt[index].children_sum    = pt[index].children_num;
-  pt[index].mem_kbyte_sum   = pt[index].mem_kbyte;
-  pt[index].cpu_percent_sum = pt[index].cpu_percent;
-
-  for (i = 0; i < pt[index].children_num; i++)
-    fillprocesstree(pt, pt[index].children[i]);
-
-  if (pt[index].parent != -1 && pt[index].parent != index) {
-    parent_pt                   = &pt[pt[index].parent];
-    parent_pt->children_sum    += pt[index].children_sum;
-    parent_pt->mem_kbyte_sum   += pt[index].mem_kbyte_sum;
-    parent_pt->cpu_percent_sum += pt[index].cpu_percent_sum;
-    parent_pt->cpu_percent_sum  = (pt[index].cpu_percent_sum > 1000) ? 1000 : parent_pt->cpu_percent_sum;
-  } 
+void freeprocessaggregate(ProcessAggregate_T *a) {
+  ASSERT(a);
+
+  FREE(a->order);
+  FREE(a->first);
+  FREE(a->children_sum);
+  FREE(a->cpu_sum);
+  FREE(a->mem_sum);
+  a->size = 0;
 }
 
@@ -30,20 +30,46 @@
 #ifndef MONIT_PROCESS_SYSDEP_H
 #define MONIT_PROCESS_SYSDEP_H
 
+/** Defines the usage counters of a cgroup */
+typedef struct mycgroupusage {
+  unsigned long long cpu_usec;                           /**< CPU usage [us] */
+  unsigned long long mem_bytes;     /**< Memory usage without inactive files */
+  unsigned long long io_read;                                /**< Bytes read */
+  unsigned long long io_write;                            /**< Bytes written */
+} CgroupUsage_T;
+
+/** Defines the work arrays of the process tree aggregation, kept across
+ * cycles and grown with the process tree */
+typedef struct myprocessaggregate {
+  int            size;                                /**< Allocated entries */
+  int           *order;                   /**< Topological order of the tree */
+  int           *first;               /**< First child position in the order */
+  int           *children_sum;           /**< Children sum by order position */
+  int           *cpu_sum;                     /**< CPU sum by order position */
+  unsigned long *mem_sum;                  /**< Memory sum by order position */
+} ProcessAggregate_T;
+
 int init_process_info_sysdep(void);
 int init_proc_info_sysdep(void);
 
+char *get_proc_root(void);
 int read_proc_file(char *, int, char *, int, int *);
 int getloadavg_sysdep (double *, int);
 int used_system_memory_sysdep(SystemInfo_T *);
 int used_system_cpu_sysdep(SystemInfo_T *);
+int used_system_pressure_sysdep(SystemInfo_T *);
+int sample_system_cpu_sysdep(int *, int *, int *);
+int sample_process_cpu_sysdep(int, double *);
+int get_cgroup_sysdep(int, char *, int);
+int used_cgroup_sysdep(const char *, CgroupUsage_T *);
 
 double get_float_time(void);
 
 int    initprocesstree_sysdep(ProcessTree_T **);
-void   fillprocesstree(ProcessTree_T *, int);
+void   fillprocesstree(ProcessTree_T *, int, int, ProcessAggregate_T *);
+void   freeprocessaggregate(ProcessAggregate_T *);
 
-int    connectchild(ProcessTree_T *, int, int);
+int    hasprocesscmdline(int, time_t);
 
 
 #endif
@@ -250,6 +250,8 @@ int initprocesstree_sysdep(ProcessTree_T ** reference) {
   }
 
   FREE(procs);
+  /* The table of the previous scan isn't reused */
+  FREE(*reference);
   *reference = pt;
 
   return treesize;
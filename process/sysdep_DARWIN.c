@@ -272,6 +272,8 @@ int initprocesstree_sysdep(ProcessTree_T **reference) {
   FREE(args);
   FREE(pinfo);
 
+  /* The table of the previous scan isn't reused */
+  FREE(*reference);
   *reference = pt;
 
   return treesize;
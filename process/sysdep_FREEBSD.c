@@ -211,6 +211,8 @@ int initprocesstree_sysdep(ProcessTree_T **reference) {
       pt[i].cmdline = xstrdup(procname);
   }
 
+  /* The table of the previous scan isn't reused */
+  FREE(*reference);
   *reference = pt;
   kvm_close(kvm_handle);
 
@@ -217,6 +217,8 @@ int initprocesstree_sysdep(ProcessTree_T ** reference) {
       pt[i].status_flag |= PROCESS_ZOMBIE;
   }
 
+  /* The table of the previous scan isn't reused */
+  FREE(*reference);
   *reference = pt;
 
   return treesize;
@@ -80,8 +80,12 @@
 #include <asm/param.h>
 #endif
 
-#ifdef HAVE_GLOB_H
-#include <glob.h>
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
+
+#ifdef HAVE_CTYPE_H
+#include <ctype.h>
 #endif
 
 #ifndef HZ
@@ -115,24 +119,234 @@
 #define SWAPTOTAL "SwapTotal:"
 #define SWAPFREE  "SwapFree:"
 
+/* Index of the /proc/meminfo items in the meminfo_keys array */
+#define MEMINFO_TOTAL      0
+#define MEMINFO_FREE       1
+#define MEMINFO_BUFFERS    2
+#define MEMINFO_CACHED     3
+#define MEMINFO_SWAPTOTAL  4
+#define MEMINFO_SWAPFREE   5
+
 #define NSEC_PER_SEC    1000000000L
 
-static unsigned long long old_cpu_user     = 0;
-static unsigned long long old_cpu_syst     = 0;
-static unsigned long long old_cpu_wait     = 0;
-static unsigned long long old_cpu_total    = 0;
+/* Position of the used items in /proc/<pid>/stat counted from the state */
+#define STAT_STATE      1
+#define STAT_PPID       2
+#define STAT_UTIME      12
+#define STAT_STIME      13
+#define STAT_STARTTIME  20
+#define STAT_RSS        22
+
+
+/** Defines the /proc/<pid>/stat items used by monit */
+typedef struct mystat {
+  char               name[STRLEN];                       /**< Command name */
+  char               state;                             /**< Process state */
+  int                ppid;                                 /**< Parent pid */
+  unsigned long      utime;                  /**< User time [clock ticks] */
+  unsigned long      stime;                /**< System time [clock ticks] */
+  unsigned long long starttime;  /**< Start time after boot [clock ticks] */
+  long               rss;                      /**< Resident set [pages] */
+} ProcStat_T;
+
+
+/** Defines the process table scan shared by the scan threads */
+typedef struct myprocscan {
+  int             *pids;                 /**< Pids found in /proc directory */
+  int              count;                                /**< Number of pids */
+  int              next;                    /**< The first pid not yet read */
+  ProcessTree_T   *pt;                /**< The process table, entry per pid */
+  pthread_mutex_t  mutex;                  /**< Protects the next pid index */
+} ProcScan_T;
+
+
+/** Defines a system wide proc file which is kept open and re-read */
+typedef struct myprocfile {
+  const char *name;                            /**< File name in /proc */
+  int         fd;                       /**< File descriptor, -1 if closed */
+  char       *buf;                                     /**< File content */
+  int         size;                                     /**< Buffer size */
+  int         missing;               /**< TRUE if the file doesn't exist */
+} ProcFile_T;
+
+
+/** Defines the CPU time counters of a /proc/stat cpu line [clock ticks] */
+typedef struct mycputime {
+  unsigned long long user;                            /**< User and nice time */
+  unsigned long long syst;                                   /**< System time */
+  unsigned long long wait;                                  /**< I/O wait time */
+  unsigned long long irq;                     /**< Hard and soft interrupt time */
+  unsigned long long steal;               /**< Time stolen by the hypervisor */
+  unsigned long long total;                              /**< Sum of all times */
+} CpuTime_T;
+
+
+/** Defines the directory entry returned by the getdents64 system call */
+typedef struct mydirent64 {
+  unsigned long long d_ino;                                /**< Inode number */
+  long long          d_off;                    /**< Offset of the next entry */
+  unsigned short     d_reclen;                        /**< Size of the entry */
+  unsigned char      d_type;                              /**< The file type */
+  char               d_name[];                /**< Null terminated file name */
+} Dirent64_T;
+
+
+/* Number of pids read by the scan thread at once */
+#define SCAN_CHUNK      64
+
+/* Maximal number of the process table scan threads */
+#define SCAN_THREADS    64
+
+/* Size of the /proc directory listing buffer [bytes], about 1000 entries per call */
+#define DIRENT_BUFSIZE  32768
+
+
+static time_t             boottime         = 0;
+static CpuTime_T          old_cpu          = {0ULL, 0ULL, 0ULL, 0ULL, 0ULL, 0ULL};
+static CpuTime_T         *old_cpus         = NULL;
+static int                old_cpus_count   = 0;
 static int                page_shift_to_kb = 0;
+static int                proc_dir         = -1;
+static int               *scan_pids        = NULL;
+static int                scan_pids_size   = 0;
+static int                scan_pt_size     = 0;
+static long long          dirent_buf[DIRENT_BUFSIZE / sizeof(long long)];
+static char              *cgroup_buf       = NULL;
+static int                cgroup_buf_size  = 0;
+static ProcFile_T         proc_stat        = {"stat", -1, NULL, 0, FALSE};
+static ProcFile_T         proc_meminfo     = {"meminfo", -1, NULL, 0, FALSE};
+static ProcFile_T         proc_loadavg     = {"loadavg", -1, NULL, 0, FALSE};
+static ProcFile_T         sampler_stat     = {"stat", -1, NULL, 0, FALSE};
+static ProcFile_T         proc_pressure[]  = {{"pressure/cpu", -1, NULL, 0, FALSE}, {"pressure/memory", -1, NULL, 0, FALSE}, {"pressure/io", -1, NULL, 0, FALSE}};
+static const char        *meminfo_keys[]   = {MEMTOTAL, MEMFREE, MEMBUF, MEMCACHE, SWAPTOTAL, SWAPFREE, NULL};
+
+
+/**
+ * Read the whole content of the system wide proc file. The file is
+ * opened on first use and kept open, it is re-read from offset 0 by
+ * pread(). The buffer grows until the whole file fits, the size of
+ * proc files is not known in advance. A file which doesn't exist (for
+ * example the pressure stall files on older kernels) is not retried.
+ * @param f the proc file
+ * @return the file content or NULL if failed
+ */
+static char *read_system_file(ProcFile_T *f) {
+  int bytes;
+  int total = 0;
+
+  if (f->missing)
+    return NULL;
+  if (f->fd < 0) {
+    char path[STRLEN];
+
+    snprintf(path, sizeof(path), "%s/%s", get_proc_root(), f->name);
+    if ((f->fd = open(path, O_RDONLY)) < 0) {
+      DEBUG("system statistic error -- cannot open %s: %s\n", path, STRERROR);
+      f->missing = (errno == ENOENT);
+      return NULL;
+    }
+    if (! f->buf) {
+      f->size = 4096;
+      f->buf  = xcalloc(1, f->size);
+    }
+  }
+
+  /* The proc file may be returned in pieces => read until end of file */
+  while ((bytes = pread(f->fd, f->buf + total, f->size - total - 1, total)) > 0) {
+    total += bytes;
+    if (total == f->size - 1) {
+      f->size *= 2;
+      f->buf   = xresize(f->buf, f->size);
+    }
+  }
+  if (bytes < 0) {
+    DEBUG("system statistic error -- cannot read %s/%s: %s\n", get_proc_root(), f->name, STRERROR);
+    close(f->fd);
+    f->fd = -1;
+    return NULL;
+  }
+  f->buf[total] = 0;
+
+  return f->buf;
+}
+
+
+/**
+ * Parse the "Key: value" lines of the proc file content in one pass.
+ * @param buf the proc file content
+ * @param keys NULL terminated array of the keys including the colon
+ * @param values array of the key values, a value is set only if its
+ *        key was found
+ * @return bitmap of the found keys, bit n is set if keys[n] was found
+ */
+static int parse_proc_keys(const char *buf, const char **keys, unsigned long *values) {
+  int         i;
+  int         found = 0;
+  const char *line;
+  const char *colon;
+
+  for (line = buf; *line; line++) {
+    if ((colon = strchr(line, ':'))) {
+      for (i = 0; keys[i]; i++) {
+        if (! (found & (1 << i)) && ! strncmp(line, keys[i], colon - line + 1) && ! keys[i][colon - line + 1]) {
+          values[i] = strtoul(colon + 1, NULL, 10);
+          found |= 1 << i;
+          break;
+        }
+      }
+    }
+    if (! (line = strchr(line, '\n')))
+      break;
+  }
+
+  return found;
+}
 
 
 /**
- * Get system start time
+ * Reads a file from the given process directory. The file is opened
+ * relative to the directory descriptor, so all files read through the
+ * same descriptor belong to the same process even if its pid is reused
+ * @param dirfd descriptor of the /proc/<pid> directory
+ * @param name name of the file
+ * @param buf buffer to write to
+ * @param buf_size size of buffer "buf"
+ * @param bytes_read number of bytes read to buffer
+ * @return TRUE if succeeded otherwise FALSE.
+ */
+static int read_pid_file(int dirfd, const char *name, char *buf, int buf_size, int *bytes_read) {
+  int fd;
+  int bytes;
+
+  if ((fd = openat(dirfd, name, O_RDONLY)) < 0)
+    return FALSE;
+  bytes = read(fd, buf, buf_size - 1);
+  close(fd);
+  if (bytes < 0)
+    return FALSE;
+  buf[bytes] = 0;
+  if (bytes_read)
+    *bytes_read = bytes;
+  return TRUE;
+}
+
+
+/**
+ * Get system start time. The boot time in /proc/stat is preferred since
+ * it is stable, the uptime based value may differ by one second between
+ * calls.
  * @return seconds since unix epoch
  */
-static time_t get_starttime() {
-  char   buf[1024];
-  double up = 0;
+static time_t get_boottime() {
+  char   *stat;
+  char    buf[STRLEN];
+  double  up = 0;
+  long    btime = 0;
 
-  if (! read_proc_file(buf, 1024, "uptime", -1, NULL)) {
+  if ((stat = read_system_file(&proc_stat)) && (stat = strstr(stat, "\nbtime ")) && sscanf(stat, "\nbtime %ld", &btime) == 1 && btime > 0)
+    return (time_t)btime;
+
+  if (! read_proc_file(buf, sizeof(buf), "uptime", -1, NULL)) {
     LogError("system statistic error -- cannot get system uptime\n");
     return 0;
   }
@@ -144,27 +358,108 @@ static time_t get_starttime() {
 
   return time(NULL) - (time_t)up;
 }
+
+
+/**
+ * Parse the /proc/stat cpu line. The line has the form "cpu[N] user
+ * nice system idle iowait irq softirq steal guest guest_nice", older
+ * kernels provide only the first four or seven times. The guest times
+ * are already included in the user and nice times.
+ * @param line the cpu line
+ * @param t the parsed times
+ * @return number of the times found in the line
+ */
+static int parse_cpu_line(const char *line, CpuTime_T *t) {
+  int                 i;
+  char               *end;
+  unsigned long long  v[8] = {0ULL};
+
+  for (line += strcspn(line, " \n"), i = 0; i < 8; i++, line = end) {
+    v[i] = strtoull(line, &end, 10);
+    if (end == line)
+      break;
+  }
+  t->user  = v[0] + v[1];
+  t->syst  = v[2];
+  t->wait  = v[4];
+  t->irq   = v[5] + v[6];
+  t->steal = v[7];
+  t->total = v[0] + v[1] + v[2] + v[3] + v[4] + v[5] + v[6] + v[7];
+
+  return i;
+}
+
+
+/**
+ * Parse the /proc/<pid>/stat content in one pass. The command name is
+ * enclosed in parentheses and may contain anything, including spaces
+ * and parentheses, so it is terminated by the last ')' in the buffer.
+ * For details about the format see fs/proc/array.c in the kernel.
+ * @param buf the /proc/<pid>/stat content
+ * @param stat the parsed items
+ * @return TRUE if succeeded otherwise FALSE.
+ */
+static int parse_proc_stat(char *buf, ProcStat_T *stat) {
+  int   item;
+  int   length;
+  char *name;
+  char *p;
+
+  if (! (name = strchr(buf, '(')) || ! (p = strrchr(++name, ')')))
+    return FALSE;
+  length = MIN(p - name, sizeof(stat->name) - 1);
+  memcpy(stat->name, name, length);
+  stat->name[length] = 0;
+
+  for (p++, item = 1; item <= STAT_RSS; item++) {
+    unsigned long long value = 0;
+
+    while (*p == ' ')
+      p++;
+    if (! *p)
+      return FALSE;
+
+    if (item == STAT_STATE) {
+      stat->state = *p++;
+    } else {
+      /* Signed items (e.g. priority) are skipped, the used ones can't be negative */
+      if (*p == '-')
+        p++;
+      for (; *p >= '0' && *p <= '9'; p++)
+        value = value * 10 + (*p - '0');
+      switch (item) {
+        case STAT_PPID:      stat->ppid      = (int)value;           break;
+        case STAT_UTIME:     stat->utime     = (unsigned long)value; break;
+        case STAT_STIME:     stat->stime     = (unsigned long)value; break;
+        case STAT_STARTTIME: stat->starttime = value;                break;
+        case STAT_RSS:       stat->rss       = (long)value;          break;
+      }
+    }
+
+    if (*p && *p != ' ')
+      return FALSE;
+  }
+
+  return TRUE;
+}
   
 
 /* ------------------------------------------------------------------ Public */
 
 
 int init_process_info_sysdep(void) {
-  char *ptr;
-  char  buf[1024];
-  long  page_size;
-  int   page_shift;  
+  char          *buf;
+  long           page_size;
+  int            page_shift;  
+  unsigned long  meminfo[sizeof(meminfo_keys) / sizeof(meminfo_keys[0])];
 
-  if (! read_proc_file(buf, sizeof(buf), "meminfo", -1, NULL)) 
-    return FALSE;
-  if (! (ptr = strstr(buf, MEMTOTAL))) {
-    DEBUG("system statistic error -- cannot get real memory amount\n");
+  if (! (buf = read_system_file(&proc_meminfo)))
     return FALSE;
-  }
-  if (sscanf(ptr+strlen(MEMTOTAL), "%ld", &systeminfo.mem_kbyte_max) != 1) {
+  if (! (parse_proc_keys(buf, meminfo_keys, meminfo) & (1 << MEMINFO_TOTAL))) {
     DEBUG("system statistic error -- cannot get real memory amount\n");
     return FALSE;
   }
+  systeminfo.mem_kbyte_max = meminfo[MEMINFO_TOTAL];
 
   if ((systeminfo.cpus = sysconf(_SC_NPROCESSORS_CONF)) < 0) {
     DEBUG("system statistic error -- cannot get cpu count: %s\n", STRERROR);
@@ -182,121 +477,209 @@ int init_process_info_sysdep(void) {
   for (page_shift = 0; page_size != 1; page_size >>= 1, page_shift++);
   page_shift_to_kb = page_shift - 10;
 
+  if (! (boottime = get_boottime()))
+    return FALSE;
+
   return TRUE;
 }
 
 
 /**
- * Read all processes of the proc files system to initialize
- * the process tree (sysdep version... but should work for
- * all procfs based unices) 
- * @param reference  reference of ProcessTree
- * @return treesize>0 if succeeded otherwise =0.
+ * Read the process entry from the /proc/<pid> directory
+ * @param pid the process pid
+ * @param p the process entry to fill
+ * @return TRUE if succeeded otherwise FALSE
  */
-int initprocesstree_sysdep(ProcessTree_T ** reference) {
-  int                 i = 0, j;
-  int                 rv, bytes = 0;
-  int                 treesize = 0;
-  int                 stat_ppid = 0;
-  char               *tmp = NULL;
-  char                procname[STRLEN];
-  char                buf[1024];
-  char                stat_item_state;
-  long                stat_item_cutime = 0;
-  long                stat_item_cstime = 0;
-  long                stat_item_rss = 0;
-  glob_t              globbuf;
-  unsigned long       stat_item_utime = 0;
-  unsigned long       stat_item_stime = 0;
-  unsigned long long  stat_item_starttime = 0ULL;
-  ProcessTree_T      *pt = NULL;
-
-  ASSERT(reference);
+static int read_process(int pid, ProcessTree_T *p) {
+  int        j;
+  int        piddir;
+  int        bytes = 0;
+  char       buf[1024];
+  ProcStat_T procstat;
+
+  /* The process may exit while we read the directory */
+  snprintf(buf, sizeof(buf), "%d", pid);
+  if ((piddir = openat(proc_dir, buf, O_RDONLY | O_DIRECTORY)) < 0)
+    return FALSE;
 
-  /* Find all processes in the /proc directory */
-  if ((rv = glob("/proc/[0-9]*", GLOB_ONLYDIR, NULL, &globbuf))) {
-    LogError("system statistic error -- glob failed: %d (%s)\n", rv, STRERROR);
+  if (! read_pid_file(piddir, "stat", buf, sizeof(buf), NULL)) {
+    DEBUG("system statistic error -- cannot read /proc/%d/stat\n", pid);
+    close(piddir);
     return FALSE;
-  } 
+  }
 
-  treesize = globbuf.gl_pathc;
+  memset(p, 0, sizeof(ProcessTree_T));
+  p->pid  = pid;
+  p->time = get_float_time();
 
-  pt = xcalloc(sizeof(ProcessTree_T), treesize);
+  if (! parse_proc_stat(buf, &procstat)) {
+    DEBUG("system statistic error -- file /proc/%d/stat parse error\n", p->pid);
+    goto next;
+  }
 
-  /* Insert data from /proc directory */
-  for (i = 0; i < treesize; i++) {
+  p->ppid      = procstat.ppid;
+  p->starttime = boottime + (time_t)(procstat.starttime / HZ);
+
+  /* jiffies -> seconds = 1 / HZ
+   * HZ is defined in "asm/param.h"  and it is usually 1/100s but on
+   * alpha system it is 1/1024s */
+  p->cputime     = ((float)(procstat.utime + procstat.stime) * 10.0) / HZ;
+  p->cpu_percent = 0;
+
+  /* State is Zombie -> then we are a Zombie ... clear or? (-: */
+  if (procstat.state == 'Z')
+    p->status_flag |= PROCESS_ZOMBIE;
+
+  if (page_shift_to_kb < 0)
+    p->mem_kbyte = (procstat.rss >> abs(page_shift_to_kb));
+  else
+    p->mem_kbyte = (procstat.rss << abs(page_shift_to_kb));
+
+  /* The command line is needed only for process matching, the process tree keeps the one read by a previous cycle if possible */
+  if (! Run.doprocessmatch || hasprocesscmdline(p->pid, p->starttime))
+    goto next;
+  if (! read_pid_file(piddir, "cmdline", buf, sizeof(buf), &bytes)) {
+    DEBUG("system statistic error -- cannot read /proc/%d/cmdline\n", p->pid);
+    goto next;
+  }
+  /* The cmdline file contains argv elements/strings terminated separated by '\0' => join the string: */
+  for (j = 0; j < (bytes - 1); j++)
+    if (buf[j] == 0)
+      buf[j] = ' ';
+  p->cmdline = *buf ? xstrdup(buf) : xstrdup(procstat.name);
+
+next:
+  close(piddir);
+  return TRUE;
+}
 
-    pt[i].pid = atoi(globbuf.gl_pathv[i] + strlen("/proc/"));
-    
-    if (!read_proc_file(buf, sizeof(buf), "stat", pt[i].pid, NULL)) {
-      DEBUG("system statistic error -- cannot read /proc/%d/stat\n", pt[i].pid);
-      continue;
-    }
 
-    pt[i].time = get_float_time();
+/**
+ * The process table scan thread - reads the processes in chunks until
+ * all pids found in the /proc directory are read. The process entry
+ * of a pid which could not be read is marked by pid 0.
+ * @param args the process table scan
+ */
+static void *scan_processes(void *args) {
+  ProcScan_T *scan = args;
 
-    if (!(tmp = strrchr(buf, ')'))) {
-      DEBUG("system statistic error -- file /proc/%d/stat parse error\n", pt[i].pid);
-      continue;
-    }
-    *tmp = 0;
-    if (sscanf(buf, "%*d (%256s", procname) != 1) {
-      DEBUG("system statistic error -- file /proc/%d/stat process name parse error\n", pt[i].pid);
-      continue;
+  while (TRUE) {
+    int i, first, last;
+
+    LOCK(scan->mutex)
+    {
+      first = scan->next;
+      scan->next += SCAN_CHUNK;
     }
+    END_LOCK;
+    if (first >= scan->count)
+      break;
+    last = (first + SCAN_CHUNK < scan->count) ? first + SCAN_CHUNK : scan->count;
+    for (i = first; i < last; i++)
+      if (! read_process(scan->pids[i], &scan->pt[i]))
+        scan->pt[i].pid = 0;
+  }
+  return NULL;
+}
 
-    tmp += 2;
-
-    /* This implementation is done by using fs/procfs/array.c as a basis
-     * it is also worth looking into the source of the procps utils */
-    if (sscanf(tmp,
-         "%c %d %*d %*d %*d %*d %*u %*u"
-         "%*u %*u %*u %lu %lu %ld %ld %*d %*d %*d "
-         "%*u %llu %*u %ld %*u %*u %*u %*u %*u "
-         "%*u %*u %*u %*u %*u %*u %*u %*u %*d %*d\n",
-         &stat_item_state,
-         &stat_ppid,
-         &stat_item_utime,
-         &stat_item_stime,
-         &stat_item_cutime,
-         &stat_item_cstime,
-         &stat_item_starttime,
-         &stat_item_rss) != 8) {
-      DEBUG("system statistic error -- file /proc/%d/stat parse error\n", pt[i].pid);
-      continue;
+
+/**
+ * The additional process table scan thread
+ * @param args the process table scan
+ */
+static void *scan_thread(void *args) {
+  sigset_t ns;
+
+  set_signal_block(&ns, NULL);
+  return scan_processes(args);
+}
+
+
+/**
+ * Read all processes of the proc files system to initialize
+ * the process tree. The /proc directory is kept open and listed
+ * by the getdents64 system call into a static buffer, which needs
+ * no allocation per entry and reads many entries at once, unlike
+ * readdir(). The pids found there are read by Run.processthreads
+ * threads into the
+ * preallocated process table. The pid list and the process table
+ * of the previous scan are reused, they grow only when there are
+ * more processes.
+ * @param reference  reference of ProcessTree, the table of the
+ * previous scan or NULL
+ * @return treesize>0 if succeeded otherwise =0.
+ */
+int initprocesstree_sysdep(ProcessTree_T ** reference) {
+  int             i;
+  int             threads;
+  int             bytes;
+  int             treesize = 0;
+  ProcScan_T      scan;
+  pthread_t       thread[SCAN_THREADS];
+
+  ASSERT(reference);
+
+  if (proc_dir < 0 && (proc_dir = open(get_proc_root(), O_RDONLY | O_DIRECTORY)) < 0) {
+    LogError("system statistic error -- cannot open %s: %s\n", get_proc_root(), STRERROR);
+    return FALSE;
+  }
+  lseek(proc_dir, 0, SEEK_SET);
+
+  /* List the pids from /proc directory */
+  memset(&scan, 0, sizeof(scan));
+  while ((bytes = syscall(SYS_getdents64, proc_dir, dirent_buf, sizeof(dirent_buf))) > 0) {
+    int         offset;
+    Dirent64_T *de;
+
+    for (offset = 0; offset < bytes; offset += de->d_reclen) {
+      de = (Dirent64_T *)((char *)dirent_buf + offset);
+
+      if (! isdigit((int)*de->d_name))
+        continue;
+      if (scan.count == scan_pids_size) {
+        scan_pids_size = scan_pids_size ? 2 * scan_pids_size : 256;
+        scan_pids = xresize(scan_pids, scan_pids_size * sizeof(int));
+      }
+      scan_pids[scan.count++] = atoi(de->d_name);
     }
-    
-    pt[i].ppid      = stat_ppid;
-    pt[i].starttime = get_starttime() + (time_t)(stat_item_starttime / HZ);
-  
-    /* jiffies -> seconds = 1 / HZ
-     * HZ is defined in "asm/param.h"  and it is usually 1/100s but on
-     * alpha system it is 1/1024s */
-    pt[i].cputime     = ((float)(stat_item_utime + stat_item_stime) * 10.0) / HZ;
-    pt[i].cpu_percent = 0;
-
-    /* State is Zombie -> then we are a Zombie ... clear or? (-: */
-    if (stat_item_state == 'Z')
-      pt[i].status_flag |= PROCESS_ZOMBIE;
-
-    if (page_shift_to_kb < 0)
-      pt[i].mem_kbyte = (stat_item_rss >> abs(page_shift_to_kb));
-    else
-      pt[i].mem_kbyte = (stat_item_rss << abs(page_shift_to_kb));
-
-    if (! read_proc_file(buf, sizeof(buf), "cmdline", pt[i].pid, &bytes)) {
-      DEBUG("system statistic error -- cannot read /proc/%d/cmdline\n", pt[i].pid);
-      continue;
+  }
+  if (bytes < 0)
+    LogError("system statistic error -- cannot list %s: %s\n", get_proc_root(), STRERROR);
+  if (! scan.count)
+    return FALSE;
+  scan.pids = scan_pids;
+
+  /* The entries are filled by read_process() or marked by pid 0, no clearing is needed */
+  if (! *reference)
+    scan_pt_size = 0;
+  if (scan.count > scan_pt_size) {
+    scan_pt_size = scan.count + scan.count / 4;
+    *reference = xresize(*reference, scan_pt_size * sizeof(ProcessTree_T));
+  }
+
+  /* Read the processes, the current thread is one of the scan threads */
+  scan.pt = *reference;
+  pthread_mutex_init(&scan.mutex, NULL);
+  threads = Run.processthreads > SCAN_THREADS ? SCAN_THREADS : Run.processthreads;
+  if (threads > scan.count / SCAN_CHUNK)
+    threads = scan.count / SCAN_CHUNK;
+  for (i = 0; i < threads - 1; i++) {
+    int status;
+    if ((status = pthread_create(&thread[i], NULL, scan_thread, &scan)) != 0) {
+      DEBUG("system statistic -- cannot create the process table scan thread: %s\n", strerror(status));
+      break;
     }
-    /* The cmdline file contains argv elements/strings terminated separated by '\0' => join the string: */
-    for (j = 0; j < (bytes - 1); j++)
-      if (buf[j] == 0)
-        buf[j] = ' ';
-    pt[i].cmdline = *buf ? xstrdup(buf) : xstrdup(procname);
   }
-  
-  *reference = pt;
-  globfree(&globbuf);
+  threads = i;
+  scan_processes(&scan);
+  for (i = 0; i < threads; i++)
+    pthread_join(thread[i], NULL);
+  pthread_mutex_destroy(&scan.mutex);
+
+  /* Drop the processes which exited during the scan */
+  for (i = 0; i < scan.count; i++)
+    if (scan.pt[i].pid)
+      scan.pt[treesize++] = scan.pt[i];
 
   return treesize;
 }
@@ -310,7 +693,13 @@ int initprocesstree_sysdep(ProcessTree_T ** reference) {
  * @return: 0 if successful, -1 if failed (and all load averages are 0).
  */
 int getloadavg_sysdep (double *loadv, int nelem) {
-  return getloadavg(loadv, nelem);
+  char   *buf;
+  double  load[3];
+
+  if (! (buf = read_system_file(&proc_loadavg)) || sscanf(buf, "%lf %lf %lf", &load[0], &load[1], &load[2]) != 3)
+    return -1;
+  memcpy(loadv, load, (nelem > 3 ? 3 : nelem) * sizeof(double));
+  return nelem > 3 ? 3 : nelem;
 }
 
 
@@ -319,41 +708,38 @@ int getloadavg_sysdep (double *loadv, int nelem) {
  * @return: TRUE if successful, FALSE if failed
  */
 int used_system_memory_sysdep(SystemInfo_T *si) {
-  char          *ptr;
-  char           buf[1024];
-  unsigned long  mem_free = 0UL;
-  unsigned long  buffers = 0UL;
-  unsigned long  cached = 0UL;
-  unsigned long  swap_total = 0UL;
-  unsigned long  swap_free = 0UL;
+  int            found;
+  char          *buf;
+  unsigned long  meminfo[sizeof(meminfo_keys) / sizeof(meminfo_keys[0])] = {0UL};
   
-  if (! read_proc_file(buf, 1024, "meminfo", -1, NULL)) {
+  if (! (buf = read_system_file(&proc_meminfo))) {
     LogError("system statistic error -- cannot get real memory free amount\n");
     goto error;
   }
+  found = parse_proc_keys(buf, meminfo_keys, meminfo);
 
   /* Memory */
-  if (! (ptr = strstr(buf, MEMFREE)) || sscanf(ptr + strlen(MEMFREE), "%ld", &mem_free) != 1) {
+  if (! (found & (1 << MEMINFO_FREE))) {
     LogError("system statistic error -- cannot get real memory free amount\n");
     goto error;
   }
-  if (! (ptr = strstr(buf, MEMBUF)) || sscanf(ptr + strlen(MEMBUF), "%ld", &buffers) != 1)
+  if (! (found & (1 << MEMINFO_BUFFERS)))
     DEBUG("system statistic error -- cannot get real memory buffers amount\n");
-  if (! (ptr = strstr(buf, MEMCACHE)) || sscanf(ptr + strlen(MEMCACHE), "%ld", &cached) != 1)
+  if (! (found & (1 << MEMINFO_CACHED)))
     DEBUG("system statistic error -- cannot get real memory cache amount\n");
-  si->total_mem_kbyte = systeminfo.mem_kbyte_max - mem_free - buffers - cached;
+  si->total_mem_kbyte = systeminfo.mem_kbyte_max - meminfo[MEMINFO_FREE] - meminfo[MEMINFO_BUFFERS] - meminfo[MEMINFO_CACHED];
 
   /* Swap */
-  if (! (ptr = strstr(buf, SWAPTOTAL)) || sscanf(ptr + strlen(SWAPTOTAL), "%ld", &swap_total) != 1) {
+  if (! (found & (1 << MEMINFO_SWAPTOTAL))) {
     LogError("system statistic error -- cannot get swap total amount\n");
     goto error;
   }
-  if (! (ptr = strstr(buf, SWAPFREE)) || sscanf(ptr + strlen(SWAPFREE), "%ld", &swap_free) != 1) {
+  if (! (found & (1 << MEMINFO_SWAPFREE))) {
     LogError("system statistic error -- cannot get swap free amount\n");
     goto error;
   }
-  si->swap_kbyte_max   = swap_total;
-  si->total_swap_kbyte = swap_total - swap_free;
+  si->swap_kbyte_max   = meminfo[MEMINFO_SWAPTOTAL];
+  si->total_swap_kbyte = meminfo[MEMINFO_SWAPTOTAL] - meminfo[MEMINFO_SWAPFREE];
 
   return TRUE;
 
@@ -365,70 +751,300 @@ int used_system_memory_sysdep(SystemInfo_T *si) {
 
 
 /**
- * This routine returns system/user CPU time in use.
+ * This routine returns system/user CPU time in use. Beside the total
+ * usage, the usage of every CPU and the busiest CPU are computed.
  * @return: TRUE if successful, FALSE if failed (or not available)
  */
 int used_system_cpu_sysdep(SystemInfo_T *si) {
-  int                rv;
-  unsigned long long cpu_total;
-  unsigned long long cpu_user;
-  unsigned long long cpu_nice;
-  unsigned long long cpu_syst;
-  unsigned long long cpu_idle;
-  unsigned long long cpu_wait;
-  unsigned long long cpu_irq;
-  unsigned long long cpu_softirq;
-  char               buf[1024];
-
-  if (!read_proc_file(buf, 1024, "stat", -1, NULL)) {
+  int        i;
+  int        cpu;
+  char      *line;
+  CpuTime_T  now;
+
+  if (! (line = read_system_file(&proc_stat))) {
     LogError("system statistic error -- cannot read /proc/stat\n");
     goto error;
   }
 
-  rv = sscanf(buf, "cpu %llu %llu %llu %llu %llu %llu %llu",
-         &cpu_user,
-         &cpu_nice,
-         &cpu_syst,
-         &cpu_idle,
-         &cpu_wait,
-         &cpu_irq,
-         &cpu_softirq);
-  if (rv < 4) {
+  /* The first line contains the total of all CPUs */
+  if (strncmp(line, "cpu ", 4) || parse_cpu_line(line, &now) < 4) {
     LogError("system statistic error -- cannot read cpu usage\n");
     goto error;
-  } else if (rv == 4) {
-    /* linux 2.4.x doesn't support these values */
-    cpu_wait    = 0;
-    cpu_irq     = 0;
-    cpu_softirq = 0;
   }
-
-  cpu_total = cpu_user + cpu_nice + cpu_syst + cpu_idle + cpu_wait + cpu_irq + cpu_softirq;
-  cpu_user  = cpu_user + cpu_nice;
-
-  if (old_cpu_total == 0) {
-    si->total_cpu_user_percent = -10;
-    si->total_cpu_syst_percent = -10;
-    si->total_cpu_wait_percent = -10;
+  if (old_cpu.total == 0 || now.total <= old_cpu.total) {
+    si->total_cpu_user_percent  = -10;
+    si->total_cpu_syst_percent  = -10;
+    si->total_cpu_wait_percent  = -10;
+    si->total_cpu_irq_percent   = -10;
+    si->total_cpu_steal_percent = -10;
   } else {
-    unsigned long long delta = cpu_total - old_cpu_total;
+    unsigned long long delta = now.total - old_cpu.total;
   
-    si->total_cpu_user_percent = (int)(1000 * (double)(cpu_user - old_cpu_user) / delta);
-    si->total_cpu_syst_percent = (int)(1000 * (double)(cpu_syst - old_cpu_syst) / delta);
-    si->total_cpu_wait_percent = (int)(1000 * (double)(cpu_wait - old_cpu_wait) / delta);
+    si->total_cpu_user_percent  = (int)(1000 * (double)(now.user - old_cpu.user) / delta);
+    si->total_cpu_syst_percent  = (int)(1000 * (double)(now.syst - old_cpu.syst) / delta);
+    si->total_cpu_wait_percent  = (int)(1000 * (double)(now.wait - old_cpu.wait) / delta);
+    si->total_cpu_irq_percent   = (int)(1000 * (double)(now.irq - old_cpu.irq) / delta);
+    si->total_cpu_steal_percent = (int)(1000 * (double)(now.steal - old_cpu.steal) / delta);
+  }
+  old_cpu = now;
+
+  /* The "cpuN" lines follow, offline CPUs are missing */
+  si->cpu_max         = 0;
+  si->cpu_max_percent = -10;
+  for (i = 0; i < si->cpu_count; i++)
+    si->cpu_percent[i] = -10;
+  while ((line = strchr(line, '\n')) && ! strncmp(++line, "cpu", 3)) {
+    if ((cpu = atoi(line + 3)) < 0 || parse_cpu_line(line, &now) < 4)
+      continue;
+    if (cpu >= si->cpu_count) {
+      si->cpu_percent = xresize(si->cpu_percent, (cpu + 1) * sizeof(int));
+      for (i = si->cpu_count; i <= cpu; i++)
+        si->cpu_percent[i] = -10;
+      si->cpu_count = cpu + 1;
+    }
+    if (cpu >= old_cpus_count) {
+      old_cpus = xresize(old_cpus, (cpu + 1) * sizeof(CpuTime_T));
+      memset(old_cpus + old_cpus_count, 0, (cpu + 1 - old_cpus_count) * sizeof(CpuTime_T));
+      old_cpus_count = cpu + 1;
+    }
+    if (old_cpus[cpu].total && now.total > old_cpus[cpu].total) {
+      unsigned long long busy = (now.user + now.syst + now.irq) - (old_cpus[cpu].user + old_cpus[cpu].syst + old_cpus[cpu].irq);
+
+      si->cpu_percent[cpu] = (int)(1000 * (double)busy / (now.total - old_cpus[cpu].total));
+      if (si->cpu_percent[cpu] > si->cpu_max_percent) {
+        si->cpu_max         = cpu;
+        si->cpu_max_percent = si->cpu_percent[cpu];
+      }
+    }
+    old_cpus[cpu] = now;
   }
 
-  old_cpu_user  = cpu_user;
-  old_cpu_syst  = cpu_syst;
-  old_cpu_wait  = cpu_wait;
-  old_cpu_total = cpu_total;
   return TRUE;
 
   error:
-  si->total_cpu_user_percent = 0;
-  si->total_cpu_syst_percent = 0;
-  si->total_cpu_wait_percent = 0;
+  si->total_cpu_user_percent  = 0;
+  si->total_cpu_syst_percent  = 0;
+  si->total_cpu_wait_percent  = 0;
+  si->total_cpu_irq_percent   = 0;
+  si->total_cpu_steal_percent = 0;
+  si->cpu_max_percent         = 0;
+  return FALSE;
+}
+
+
+/**
+ * This routine returns the pressure stall information of CPU, memory
+ * and I/O. Each file contains the "some" line and, since Linux 5.13
+ * also for CPU, the "full" line: "some avg10=0.00 avg60=0.00 avg300=0.00
+ * total=0". The values which are not available are set to -10.
+ * @return: TRUE if successful, FALSE if failed (or not available)
+ */
+int used_system_pressure_sysdep(SystemInfo_T *si) {
+  int   i;
+  int   found = FALSE;
+  char *line;
+
+  for (i = 0; i < PRESSURE_COUNT; i++)
+    si->pressure[i] = -10;
+
+  for (i = PRESSURE_CPU; i <= PRESSURE_IO; i++) {
+    if (! (line = read_system_file(&proc_pressure[i])))
+      continue;
+    for (; line; line = (line = strchr(line, '\n')) ? line + 1 : NULL) {
+      int    kind;
+      char   name[5];
+      double avg[3];
+
+      if (sscanf(line, "%4s avg10=%lf avg60=%lf avg300=%lf", name, &avg[0], &avg[1], &avg[2]) != 4)
+        continue;
+      if (! strcmp(name, "some"))
+        kind = PRESSURE_SOME;
+      else if (! strcmp(name, "full"))
+        kind = PRESSURE_FULL;
+      else
+        continue;
+      si->pressure[PRESSURE_INDEX(i, kind, PRESSURE_AVG10)]  = (int)(avg[0] * 10);
+      si->pressure[PRESSURE_INDEX(i, kind, PRESSURE_AVG60)]  = (int)(avg[1] * 10);
+      si->pressure[PRESSURE_INDEX(i, kind, PRESSURE_AVG300)] = (int)(avg[2] * 10);
+      found = TRUE;
+    }
+  }
+
+  return found;
+}
+
+
+/**
+ * This routine returns the system user, system and wait CPU usage since
+ * the previous call. It is used by the sampler thread and thus keeps
+ * its own /proc/stat descriptor and counters.
+ * @return: TRUE if successful, FALSE if failed or on the first call
+ */
+int sample_system_cpu_sysdep(int *user, int *syst, int *wait) {
+  char                *line;
+  CpuTime_T            now;
+  unsigned long long   delta;
+  static CpuTime_T     old = {0ULL, 0ULL, 0ULL, 0ULL, 0ULL, 0ULL};
+
+  if (! (line = read_system_file(&sampler_stat)) || strncmp(line, "cpu ", 4) || parse_cpu_line(line, &now) < 4)
+    return FALSE;
+  if (old.total == 0 || now.total <= old.total) {
+    old = now;
+    return FALSE;
+  }
+  delta = now.total - old.total;
+  *user = (int)(1000 * (double)(now.user - old.user) / delta);
+  *syst = (int)(1000 * (double)(now.syst - old.syst) / delta);
+  *wait = (int)(1000 * (double)(now.wait - old.wait) / delta);
+  old = now;
+
+  return TRUE;
+}
+
+
+/**
+ * This routine returns the CPU time of the process, it is used by the
+ * sampler thread. A process which exited is silently skipped.
+ * @param pid the process pid
+ * @param cputime the user and system time [1/10 s]
+ * @return: TRUE if successful, FALSE if failed
+ */
+int sample_process_cpu_sysdep(int pid, double *cputime) {
+  char       buf[1024];
+  ProcStat_T procstat;
+
+  snprintf(buf, sizeof(buf), "%s/%d/stat", get_proc_root(), pid);
+  if (! read_pid_file(AT_FDCWD, buf, buf, sizeof(buf), NULL) || ! parse_proc_stat(buf, &procstat))
+    return FALSE;
+  *cputime = ((double)(procstat.utime + procstat.stime) * 10.0) / HZ;
+
+  return TRUE;
+}
+
+
+/**
+ * Get the root of the cgroup v2 hierarchy. It is "/sys/fs/cgroup"
+ * unless the MONIT_CGROUPFS environment variable points to another
+ * directory, like MONIT_PROCFS for the proc filesystem.
+ * @return the cgroup filesystem root path
+ */
+static char *get_cgroup_root() {
+  static char *root = NULL;
+
+  if (! root) {
+    char *env = getenv("MONIT_CGROUPFS");
+    root = (env && *env) ? env : "/sys/fs/cgroup";
+  }
+  return root;
+}
+
+
+/**
+ * Read the whole content of a cgroup file. Unlike the proc files, the
+ * path differs on every call, so the file is not kept open. The buffer
+ * grows until the whole file fits (memory.stat and io.stat have no size
+ * limit) and is reused by the next call, the cgroup statistic is read
+ * by the validation thread only.
+ * @param path the file path
+ * @return the file content or NULL if failed
+ */
+static char *read_cgroup_file(const char *path) {
+  int fd;
+  int bytes;
+  int total = 0;
+
+  if ((fd = open(path, O_RDONLY)) < 0)
+    return NULL;
+  if (! cgroup_buf) {
+    cgroup_buf_size = 4096;
+    cgroup_buf      = xcalloc(1, cgroup_buf_size);
+  }
+  while ((bytes = read(fd, cgroup_buf + total, cgroup_buf_size - total - 1)) > 0) {
+    total += bytes;
+    if (total == cgroup_buf_size - 1) {
+      cgroup_buf_size *= 2;
+      cgroup_buf       = xresize(cgroup_buf, cgroup_buf_size);
+    }
+  }
+  close(fd);
+  if (bytes < 0)
+    return NULL;
+  cgroup_buf[total] = 0;
+
+  return cgroup_buf;
+}
+
+
+/**
+ * This routine returns the cgroup v2 path of the process, the path of
+ * the "0::<path>" line in /proc/<pid>/cgroup. Processes in a cgroup v1
+ * only hierarchy have no such line.
+ * @param pid the process pid
+ * @param path the buffer for the path relative to the cgroup root
+ * @param size the buffer size
+ * @return: TRUE if successful, FALSE if failed (or not available)
+ */
+int get_cgroup_sysdep(int pid, char *path, int size) {
+  char  file[STRLEN];
+  char *line;
+
+  snprintf(file, sizeof(file), "%s/%d/cgroup", get_proc_root(), pid);
+  if (! (line = read_cgroup_file(file)))
+    return FALSE;
+  for (; line; line = (line = strchr(line, '\n')) ? line + 1 : NULL) {
+    if (! strncmp(line, "0::/", 4)) {
+      line += 3;
+      snprintf(path, size, "%.*s", (int)strcspn(line, "\n"), line);
+      return TRUE;
+    }
+  }
   return FALSE;
 }
 
 
+/**
+ * This routine returns the CPU, memory and I/O usage of the cgroup. The
+ * CPU time is "usage_usec" of cpu.stat, the memory usage is
+ * memory.current without the "inactive_file" page cache of memory.stat
+ * and the I/O is the sum of "rbytes" and "wbytes" of all devices in
+ * io.stat. The io controller may be disabled, then the I/O is zero.
+ * @param path the cgroup path relative to the cgroup root
+ * @param u the usage counters
+ * @return: TRUE if successful, FALSE if failed
+ */
+int used_cgroup_sysdep(const char *path, CgroupUsage_T *u) {
+  char                file[STRLEN];
+  char               *buf;
+  char               *p;
+  unsigned long long  value;
+
+  memset(u, 0, sizeof(CgroupUsage_T));
+
+  snprintf(file, sizeof(file), "%s%s/cpu.stat", get_cgroup_root(), path);
+  if (! (buf = read_cgroup_file(file)) || ! (p = strstr(buf, "usage_usec ")) || sscanf(p, "usage_usec %llu", &u->cpu_usec) != 1) {
+    DEBUG("system statistic error -- cannot read %s\n", file);
+    return FALSE;
+  }
+
+  snprintf(file, sizeof(file), "%s%s/memory.current", get_cgroup_root(), path);
+  if (! (buf = read_cgroup_file(file)) || sscanf(buf, "%llu", &u->mem_bytes) != 1) {
+    DEBUG("system statistic error -- cannot read %s\n", file);
+    return FALSE;
+  }
+  snprintf(file, sizeof(file), "%s%s/memory.stat", get_cgroup_root(), path);
+  if ((buf = read_cgroup_file(file)) && (p = strstr(buf, "\ninactive_file ")) && sscanf(p, "\ninactive_file %llu", &value) == 1 && value <= u->mem_bytes)
+    u->mem_bytes -= value;
+
+  /* Lines of the form "8:0 rbytes=1 wbytes=2 rios=3 wios=4 dbytes=0 dios=0" */
+  snprintf(file, sizeof(file), "%s%s/io.stat", get_cgroup_root(), path);
+  if ((buf = read_cgroup_file(file))) {
+    for (p = buf; (p = strstr(p, "bytes=")); p += 6) {
+      if (p - buf > 0 && p[-1] == 'r' && sscanf(p, "bytes=%llu", &value) == 1)
+        u->io_read += value;
+      else if (p - buf > 0 && p[-1] == 'w' && sscanf(p, "bytes=%llu", &value) == 1)
+        u->io_write += value;
+    }
+  }
+
+  return TRUE;
+}
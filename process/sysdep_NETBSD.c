@@ -210,6 +210,8 @@ int initprocesstree_sysdep(ProcessTree_T ** reference) {
   FREE(pinfo);
   kvm_close(kvm_handle);
 
+  /* The table of the previous scan isn't reused */
+  FREE(*reference);
   *reference = pt;
 
   return treesize;
@@ -223,6 +223,8 @@ int initprocesstree_sysdep(ProcessTree_T ** reference) {
     }
   }
   
+  /* The table of the previous scan isn't reused */
+  FREE(*reference);
   *reference = pt;
 
   /* Free globbing buffer */
@@ -58,12 +58,21 @@
  *
  *  @file
  */
+/* The state of the non blocking generic test */
+struct generic_probe {
+  Generic_T g;                                 /* The current send or expect */
+  char     *send;                               /* The unescaped send string */
+  char     *buf;                                        /* The expect buffer */
+};
+
+
+static int check_expect(Generic_T g, char *buf);
+static int probe_done(Probe_T P, int ok);
+
+
 int check_generic(Socket_T s) {
   Generic_T g= NULL;
   char *buf;
-#ifdef HAVE_REGEX_H
-  int regex_return;
-#endif
   
   ASSERT(s);
 
@@ -102,28 +111,10 @@ int check_generic(Socket_T s) {
       }
       buf[n]= 0;
       
-#ifdef HAVE_REGEX_H
-      regex_return= regexec(g->expect, buf, 0, NULL, 0);
-      if (regex_return != 0) {
-        char e[STRLEN];
-        regerror(regex_return, g->expect, e, STRLEN);
-        LogError("GENERIC: receiving unexpected data [%s] -- %s\n", Util_trunc(buf, STRLEN - 4), e);
-        FREE(buf);
-        return FALSE;
-      } else
-        DEBUG("GENERIC: successfully received: '%s'\n", Util_trunc(buf, STRLEN - 4)); 
-      
-#else
-      /* w/o regex support */
-
-      if (strncmp(buf, g->expect, strlen(g->expect)) != 0) {
-        LogError("GENERIC: receiving unexpected data [%s]\n", Util_trunc(buf, STRLEN - 4));
+      if (! check_expect(g, buf)) {
         FREE(buf);
         return FALSE;
-      } else
-        DEBUG("GENERIC: successfully received: '%s'\n", Util_trunc(buf, STRLEN - 4)); 
-      
-#endif
+      }
       
     } else {
       /* This should not happen */
@@ -139,3 +130,103 @@ int check_generic(Socket_T s) {
     
 }
 
+
+/**
+ * The generic test as a probe_ports() step. Every expect reads until
+ * the buffer is full, the server closed the connection or the timeout
+ * passed, just like socket_read() in check_generic().
+ */
+int probe_generic(Probe_T P) {
+  struct generic_probe *G= P->data;
+
+  ASSERT(P);
+
+  if(! G) {
+    NEW(G);
+    G->g= P->port->generic;
+    P->data= G;
+  } else if(G->g->send) {
+    if(P->eof) {
+      LogError("GENERIC: error sending data -- %s\n", strerror(P->error));
+      return probe_done(P, FALSE);
+    }
+    DEBUG("GENERIC: successfully sent: '%s'\n", G->g->send); 
+    G->g= G->g->next;
+  } else {
+    if(P->inlength < Run.expectbuffer && ! P->eof)
+      return PROBE_RECEIVE;
+    G->buf[P->inlength]= 0;
+    if(! check_expect(G->g, G->buf))
+      return probe_done(P, FALSE);
+    G->g= G->g->next;
+  }
+
+  if(! G->g)
+    return probe_done(P, TRUE);
+
+  if(G->g->send) {
+    FREE(G->send);
+    G->send= xstrdup(G->g->send);
+    P->out= G->send;
+    P->outlength= Util_handle0Escapes(G->send);
+    return PROBE_SEND;
+  } else if(G->g->expect) {
+    if(! G->buf)
+      G->buf= xcalloc(sizeof(char), Run.expectbuffer + 1);
+    P->in= G->buf;
+    P->insize= Run.expectbuffer;
+    P->inlength= 0;
+    return PROBE_RECEIVE;
+  }
+
+  /* This should not happen */
+  LogError("GENERIC: unexpected strageness\n");
+  return probe_done(P, FALSE);
+
+}
+
+
+/**
+ * Compare the received data with the expect string
+ * @return TRUE if the data match, otherwise FALSE
+ */
+static int check_expect(Generic_T g, char *buf) {
+#ifdef HAVE_REGEX_H
+  int regex_return;
+
+  regex_return= regexec(g->expect, buf, 0, NULL, 0);
+  if (regex_return != 0) {
+    char e[STRLEN];
+    regerror(regex_return, g->expect, e, STRLEN);
+    LogError("GENERIC: receiving unexpected data [%s] -- %s\n", Util_trunc(buf, STRLEN - 4), e);
+    return FALSE;
+  } else
+    DEBUG("GENERIC: successfully received: '%s'\n", Util_trunc(buf, STRLEN - 4)); 
+      
+#else
+  /* w/o regex support */
+
+  if (strncmp(buf, g->expect, strlen(g->expect)) != 0) {
+    LogError("GENERIC: receiving unexpected data [%s]\n", Util_trunc(buf, STRLEN - 4));
+    return FALSE;
+  } else
+    DEBUG("GENERIC: successfully received: '%s'\n", Util_trunc(buf, STRLEN - 4)); 
+      
+#endif
+  return TRUE;
+}
+
+
+/**
+ * Free the generic probe state
+ */
+static int probe_done(Probe_T P, int ok) {
+  struct generic_probe *G= P->data;
+
+  FREE(G->send);
+  FREE(G->buf);
+  FREE(P->data);
+  P->in= NULL;
+  P->failed= ! ok;
+  return PROBE_DONE;
+}
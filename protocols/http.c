@@ -92,6 +92,25 @@
 #define  READ_SIZE  8192
 #define  LINE_SIZE  512
 
+/* The states of the non blocking HTTP test */
+#define  HTTP_REQUEST  0
+#define  HTTP_STATUS   1
+#define  HTTP_HEADER   2
+#define  HTTP_CONTENT  3
+
+/* The response of the non blocking HTTP test */
+typedef struct http_probe {
+  char  *request;                                        /* The request sent */
+  char   buf[READ_SIZE];                            /* The response received */
+  long   content_length;                  /* Content-Length or -1 if not set */
+  char  *content;                          /* The content for the regex test */
+  long   content_size;                       /* Size of the content received */
+  long   content_max;                    /* Size of the content to be tested */
+  long   checksum_length;                   /* Content left for the checksum */
+  struct md5_ctx md5;
+  struct sha_ctx sha;
+} *HttpProbe_T;
+
 
 /* -------------------------------------------------------------- Prototypes */
 
@@ -100,6 +119,12 @@ static int check_request(Socket_T s, Port_T P);
 static char *get_auth_header(Port_T P, char *auth, int l);
 static int do_regex(Socket_T s, long content_length, Request_T R);
 static int check_request_checksum(Socket_T s, long content_length, char *checksum, int hashtype);
+static int match_content(char *buf, Request_T R);
+static int compare_checksum(unsigned char *hash, int keylength, char *checksum);
+static int probe_line(Probe_T P, HttpProbe_T H, char *line);
+static int probe_header(Probe_T P, HttpProbe_T H, char *line);
+static int probe_content(Probe_T P, HttpProbe_T H);
+static int probe_done(Probe_T P, int ok);
 
 
 /* ------------------------------------------------------------------ Public */
@@ -141,6 +166,106 @@ int check_http(Socket_T s) {
   
 }
 
+/**
+ * The HTTP test as a probe_ports() step. The response is parsed as it
+ * arrives: the status line, the headers and then the content, which is
+ * fed to the regex buffer and to the checksum at once.
+ */
+int probe_http(Probe_T P) {
+
+  HttpProbe_T H= P->data;
+  char line[LINE_SIZE];
+
+  ASSERT(P);
+
+  switch(P->state) {
+
+  case HTTP_REQUEST:
+    if(! H) {
+      char auth[STRLEN]= {0};
+      char host[STRLEN];
+      Port_T Q= P->port;
+
+      if(Q->port == 80)
+        snprintf(host, STRLEN, "%s", Q->family == AF_UNIX ? LOCALHOST : Q->hostname);
+      else
+        snprintf(host, STRLEN, "%s:%d", Q->family == AF_UNIX ? LOCALHOST : Q->hostname, Q->port);
+      NEW(H);
+      H->content_length= -1;
+      H->request= Util_getString(
+		  "GET %s HTTP/1.1\r\n"
+		  "Host: %s\r\n"
+		  "Accept: */*\r\n"
+		  "Connection: close\r\n"
+		  "User-Agent: %s/%s\r\n"
+		  "%s\r\n",
+		  Q->request?Q->request:"/", 
+                  Q->request_hostheader?Q->request_hostheader:host, 
+                  prog, VERSION, get_auth_header(Q, auth, STRLEN));
+      P->data= H;
+      P->out= H->request;
+      P->outlength= strlen(H->request);
+      return PROBE_SEND;
+    }
+    if(P->eof) {
+      LogError("HTTP: error sending data -- %s\n", strerror(P->error));
+      return probe_done(P, FALSE);
+    }
+    P->in= H->buf;
+    P->insize= READ_SIZE;
+    P->inlength= 0;
+    P->state= HTTP_STATUS;
+    return PROBE_RECEIVE;
+
+  case HTTP_STATUS:
+  case HTTP_HEADER:
+    while(P->state != HTTP_CONTENT) {
+      if(! probe_line(P, H, line)) {
+        if(P->eof)
+          break;
+        return PROBE_RECEIVE;
+      }
+      if(! probe_header(P, H, line))
+        return probe_done(P, FALSE);
+    }
+    if(P->state != HTTP_CONTENT) {
+      /* The response ended in the headers */
+      if(P->state == HTTP_STATUS) {
+        LogError("HTTP: error receiving data -- %s\n", strerror(P->error));
+        return probe_done(P, FALSE);
+      }
+      P->state= HTTP_CONTENT;
+    }
+    if(P->port->url_request && P->port->url_request->regex) {
+      if(H->content_length == 0) {
+        LogError("HTTP error: Cannot test regex -- No content returned "
+          "from server\n");
+        LogError("HTTP error: Failed regular expression test on content"
+          " returned from server\n");
+        return probe_done(P, FALSE);
+      }
+      H->content_max= (H->content_length < 0 || H->content_length > HTTP_CONTENT_MAX) ? HTTP_CONTENT_MAX : H->content_length;
+      H->content= xmalloc(H->content_max + 1);
+    }
+    if(P->port->request_checksum) {
+      if(H->content_length <= 0) {
+        DEBUG("HTTP warning: Response does not contain a valid Content-Length\n"
+          "Cannot compute checksum\n");
+      } else {
+        H->checksum_length= H->content_length;
+        md5_init_ctx(&H->md5);
+        sha_init_ctx(&H->sha);
+      }
+    }
+    /* fall through */
+
+  default:
+    return probe_content(P, H);
+
+  }
+
+}
+
 
 /* ----------------------------------------------------------------- Private */
 
@@ -219,7 +344,6 @@ static int check_request_checksum(Socket_T s, long content_length, char *checksu
 
   int n;
   long size;
-  MD_T result;
   char buf[READ_SIZE];
   unsigned char hash[STRLEN];
   int  keylength=0;
@@ -266,14 +390,7 @@ static int check_request_checksum(Socket_T s, long content_length, char *checksu
     return FALSE;
   }          
 
-  if(strncasecmp(Util_digest2Bytes(hash, keylength, result), checksum, keylength*2) != 0) {
-    DEBUG("HTTP warning: Document checksum mismatch\n");
-    return FALSE;
-  } else {
-    DEBUG("HTTP: Succeeded testing document checksum\n");
-  }
-
-  return TRUE;
+  return compare_checksum(hash, keylength, checksum);
 
 }
 
@@ -285,11 +402,6 @@ static int do_regex(Socket_T s, long content_length, Request_T R) {
   int rv= TRUE;
   int length= 0;
   char *buf= NULL;
-#ifdef HAVE_REGEX_H
-  int regex_return;
-#else
-  char *regex_return;
-#endif
 
   if(R->regex == NULL) {
     return TRUE;
@@ -325,6 +437,27 @@ static int do_regex(Socket_T s, long content_length, Request_T R) {
   }
   buf[size]= 0;
 
+  rv= match_content(buf, R);
+  
+error:
+  FREE(buf);
+  return rv;
+  
+}
+
+/**
+ * Test the content regular expression
+ * @return TRUE if the test succeeded otherwise FALSE
+ */
+static int match_content(char *buf, Request_T R) {
+
+  int rv= TRUE;
+#ifdef HAVE_REGEX_H
+  int regex_return;
+#else
+  char *regex_return;
+#endif
+
 #ifdef HAVE_REGEX_H
 
       regex_return=regexec(R->regex,
@@ -381,11 +514,29 @@ static int do_regex(Socket_T s, long content_length, Request_T R) {
       }
       
 #endif
-  
-error:
-  FREE(buf);
+
   return rv;
-  
+
+}
+
+
+/**
+ * Compare the document digest with the expected checksum
+ * @return TRUE if the checksum matches otherwise FALSE
+ */
+static int compare_checksum(unsigned char *hash, int keylength, char *checksum) {
+
+  MD_T result;
+
+  if(strncasecmp(Util_digest2Bytes(hash, keylength, result), checksum, keylength*2) != 0) {
+    DEBUG("HTTP warning: Document checksum mismatch\n");
+    return FALSE;
+  } else {
+    DEBUG("HTTP: Succeeded testing document checksum\n");
+  }
+
+  return TRUE;
+
 }
 
 
@@ -419,3 +570,159 @@ static char *get_auth_header(Port_T P, char *auth, int l) {
   return auth;
 
 }
+
+
+/**
+ * Take the next response line of the non blocking HTTP test, lines
+ * longer than LINE_SIZE are split as by socket_readln(). The partial
+ * last line is taken at the end of the input.
+ * @return TRUE if a line was taken, FALSE if more input is needed
+ */
+static int probe_line(Probe_T P, HttpProbe_T H, char *line) {
+
+  int n;
+  char *end;
+  int length= MIN(P->inlength, LINE_SIZE - 1);
+
+  if((end= memchr(H->buf, '\n', length)))
+    n= end - H->buf + 1;
+  else if(length == LINE_SIZE - 1 || (P->eof && length > 0))
+    n= length;
+  else
+    return FALSE;
+
+  memcpy(line, H->buf, n);
+  line[n]= 0;
+  P->inlength-= n;
+  memmove(H->buf, H->buf + n, P->inlength);
+  return TRUE;
+
+}
+
+
+/**
+ * Check the status line or a header line of the non blocking HTTP test
+ * @return TRUE if the line is valid otherwise FALSE
+ */
+static int probe_header(Probe_T P, HttpProbe_T H, char *line) {
+
+  int status;
+
+  if(P->state == HTTP_STATUS) {
+    Util_chomp(line);
+    if(! sscanf(line, "%*s %d", &status)) {
+      LogError("HTTP error: cannot parse HTTP status in response: %s\n", line);
+      return FALSE;
+    }
+    if(status >= 400) {
+      LogError("HTTP error: Server returned status %d\n", status);
+      return FALSE;
+    }
+    P->state= HTTP_HEADER;
+    return TRUE;
+  }
+
+  if((line[0] == '\r' && line[1] == '\n') || (line[0] == '\n')) {
+    P->state= HTTP_CONTENT;
+    return TRUE;
+  }
+
+  Util_chomp(line);
+
+  if(Util_startsWith(line, "Content-Length")) {
+    if(! sscanf(line, "%*s%*[: ]%ld", &H->content_length)) {
+      LogError("HTTP error: parsing Content-Length response header '%s'\n",
+        line);
+      return FALSE;
+    }
+    if(H->content_length < 0) {
+      LogError("HTTP error: Illegal Content-Length response header '%s'\n",
+        line);
+      return FALSE;
+    }
+  }
+  return TRUE;
+
+}
+
+
+/**
+ * Feed the received content of the non blocking HTTP test to the regex
+ * buffer and to the checksum, test them when all content was received
+ */
+static int probe_content(Probe_T P, HttpProbe_T H) {
+
+  int rv= TRUE;
+
+  if(H->content && H->content_size < H->content_max) {
+    long n= MIN(P->inlength, H->content_max - H->content_size);
+    memcpy(H->content + H->content_size, H->buf, n);
+    H->content_size+= n;
+  }
+  if(H->checksum_length > 0) {
+    long n= MIN(P->inlength, H->checksum_length);
+    if(P->port->request_hashtype == HASH_MD5)
+      md5_process_bytes(H->buf, n, &H->md5);
+    else
+      sha_process_bytes(H->buf, n, &H->sha);
+    H->checksum_length-= n;
+  }
+  P->inlength= 0;
+
+  if(! P->eof && ((H->content && H->content_size < H->content_max) || H->checksum_length > 0))
+    return PROBE_RECEIVE;
+
+  if(H->content) {
+    if(H->content_size == 0) {
+      LogError("HTTP: error receiving data -- %s\n", strerror(P->error));
+      rv= FALSE;
+    } else {
+      H->content[H->content_size]= 0;
+      rv= match_content(H->content, P->port->url_request);
+    }
+    if(! rv) {
+      LogError("HTTP error: Failed regular expression test on content"
+        " returned from server\n");
+      return probe_done(P, FALSE);
+    }
+  }
+
+  if(P->port->request_checksum && H->content_length > 0) {
+    unsigned char hash[STRLEN];
+    switch(P->port->request_hashtype) {
+    case HASH_MD5:
+      md5_finish_ctx(&H->md5, hash);
+      rv= compare_checksum(hash, 16, P->port->request_checksum);
+      break;
+    case HASH_SHA1:
+      sha_finish_ctx(&H->sha, hash);
+      rv= compare_checksum(hash, 20, P->port->request_checksum);
+      break;
+    default:
+      DEBUG("HTTP warning: Unknown hash type\n");
+      rv= FALSE;
+    }
+  }
+
+  return probe_done(P, rv);
+
+}
+
+
+/**
+ * Free the state of the non blocking HTTP test
+ */
+static int probe_done(Probe_T P, int ok) {
+
+  HttpProbe_T H= P->data;
+
+  if(H) {
+    FREE(H->request);
+    FREE(H->content);
+    FREE(P->data);
+  }
+  P->in= NULL;
+  P->failed= ! ok;
+  return PROBE_DONE;
+
+}
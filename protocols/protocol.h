@@ -35,6 +35,7 @@
 
 #include "monitor.h"
 #include "socket.h"
+#include "net.h"
 
 /* Protocols supported */
 #define P_DEFAULT         1
@@ -125,5 +126,9 @@ int check_gps(Socket_T);
 int check_radius(Socket_T);
 int check_memcache(Socket_T);
 
+/* Non blocking protocol tests, see probe_ports() */
+int probe_generic(Probe_T);
+int probe_http(Probe_T);
+
 
 #endif
@@ -0,0 +1,951 @@
+/*
+ * Copyright (C) 2011 Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+
+
+#include <config.h>
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_STDDEF_H
+#include <stddef.h>
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_DIRENT_H
+#include <dirent.h>
+#endif
+
+#include "monitor.h"
+#include "event.h"
+#include "file.h"
+#include "queue.h"
+
+
+/**
+ *  Persistent event queue stored as an append-only segmented log.
+ *
+ *  The queue directory contains the segment files named by their
+ *  sequence number, for example 0000002a.seg, and the index file with
+ *  the replay position. A record is a header followed by the payload:
+ *
+ *    magic | payload length | CRC-32 of the payload | state
+ *    version | event size | event | action | source | message
+ *
+ *  The events are appended to the active segment, a new segment is
+ *  started when the active one would exceed QUEUE_SEGMENT_SIZE and on
+ *  every start of monit, so a torn record left by a crash is never
+ *  followed by new records.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define QUEUE_MAGIC        0x4d514c31               /* Record magic, "MQL1" */
+#define QUEUE_SEGMENT_SIZE 1048576               /* Segment rotation size [B] */
+#define QUEUE_RECORD_SIZE  1048576                  /* Maximal payload size [B] */
+
+#define RECORD_PENDING     0
+#define RECORD_DELIVERED   1
+
+
+/* The record header, followed by the payload */
+struct myrecord {
+  unsigned int magic;                                       /**< QUEUE_MAGIC */
+  unsigned int length;                               /**< Payload length [B] */
+  unsigned int crc;                              /**< CRC-32 of the payload */
+  unsigned int state;                  /**< RECORD_PENDING or RECORD_DELIVERED */
+};
+
+
+static struct myqueue {
+  char         *dir;                  /**< Queue directory or NULL if closed */
+  int           fd;                  /**< Active segment descriptor or -1 */
+  unsigned int  head;              /**< First segment with pending records */
+  long          position;          /**< Replay position in the head segment */
+  unsigned int  tail;                              /**< The active segment */
+  long          size;                     /**< Size of the active segment */
+  int           count;                     /**< Number of pending records */
+} queue = {NULL, -1, 0, 0, 0, 0, 0};
+
+static unsigned int crcTable[256];
+
+/* The event structure of the per-file queue of monit 5.2.5 and older */
+#define LEGACY_VERSION 3
+struct myevent_v3 {
+  int               id;
+  struct timeval    collected;
+  char             *source;
+  int               mode;
+  int               type;
+  short             state;
+  short             state_changed;
+  long long         state_map;
+  unsigned int      count;
+  unsigned int      flag;
+  char             *message;
+  EventAction_T     action;
+  struct myevent   *next;
+  struct myevent   *previous;
+};
+
+
+/* -------------------------------------------------------------- Prototypes */
+
+
+static int          open_queue(void);
+static int          is_legacy(const char *);
+static void         import_legacy(void);
+static Event_T      read_legacy(const char *);
+static void        *read_legacy_item(FILE *, int *);
+static int          compare_names(const void *, const void *);
+static char        *segment_path(unsigned int, char *, int);
+static int          read_record(FILE *, struct myrecord *, char **);
+static int          append_record(const char *, unsigned int);
+static int          mark_delivered(FILE *, long);
+static int          count_pending(unsigned int);
+static void         compact(void);
+static void         save_index(void);
+static char        *serialize(Event_T, unsigned int *);
+static Event_T      deserialize(const char *, unsigned int);
+static void         free_event(Event_T);
+static unsigned int checksum_crc32(const char *, unsigned int);
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+int Queue_add(Event_T E) {
+  int          rv;
+  char        *payload;
+  unsigned int length;
+
+  ASSERT(E);
+
+  if (! open_queue())
+    return FALSE;
+
+  if (Run.eventlist_slots >= 0 && queue.count >= Run.eventlist_slots) {
+    LogError("%s: Aborting event - queue over quota\n", prog);
+    return FALSE;
+  }
+
+  payload = serialize(E, &length);
+  rv = append_record(payload, length);
+  FREE(payload);
+  return rv;
+}
+
+
+void Queue_replay(int (*handler)(Event_T)) {
+  int          rv = 0;
+  int          stop = FALSE;
+  int          delivered = FALSE;
+  int          leading = TRUE;
+  unsigned int seq;
+  unsigned int end;
+  long         endsize;
+  unsigned int head;
+  long         position;
+
+  ASSERT(handler);
+
+  if (! open_queue() || ! queue.count)
+    return;
+
+  DEBUG("Processing postponed events queue\n");
+
+  /* The records appended during the replay are not replayed again */
+  end      = queue.tail;
+  endsize  = queue.size;
+  head     = queue.head;
+  position = queue.position;
+
+  for (seq = queue.head; seq <= end && ! stop; seq++) {
+    FILE *file;
+    long  offset = (seq == queue.head) ? queue.position : 0;
+    int   flips = 0;
+    char  path[STRLEN];
+
+    /* The segment may be removed by compaction or not created yet */
+    if (! (file = fopen(segment_path(seq, path, sizeof(path)), "r+"))) {
+      if (leading) {
+        head     = (seq < end) ? seq + 1 : seq;
+        position = 0;
+      }
+      continue;
+    }
+    if (offset && fseek(file, offset, SEEK_SET) < 0) {
+      LogError("%s: cannot seek in the event queue segment %s -- %s\n", prog, path, STRERROR);
+      fclose(file);
+      break;
+    }
+
+    while (! (seq == end && offset >= endsize)) {
+      struct myrecord  r;
+      char            *payload = NULL;
+      long             next;
+
+      if ((rv = read_record(file, &r, &payload)) <= 0) {
+        if (rv < 0)
+          LogError("%s: event queue segment %s is corrupted at offset %ld, the rest of the segment is dropped\n", prog, path, offset);
+        break;
+      }
+      next = offset + sizeof(r) + r.length;
+
+      if (r.state == RECORD_PENDING) {
+        Event_T e = deserialize(payload, r.length);
+
+        if (! e) {
+          LogError("%s: dropping the queued event at %s:%ld - incompatible data format\n", prog, path, offset);
+          if (mark_delivered(file, offset))
+            r.state = RECORD_DELIVERED;
+        } else {
+          switch (handler(e)) {
+            case QUEUE_STOP:
+              stop = TRUE;
+              break;
+            case QUEUE_UPDATE:
+              {
+                /* The updated event goes to the end of the queue, the original record is dropped */
+                unsigned int  length;
+                char         *update = serialize(e, &length);
+
+                if (append_record(update, length) && mark_delivered(file, offset))
+                  r.state = RECORD_DELIVERED;
+                FREE(update);
+              }
+              break;
+            case QUEUE_DONE:
+              if (mark_delivered(file, offset))
+                r.state = RECORD_DELIVERED;
+              break;
+            default:
+              break;
+          }
+          free_event(e);
+        }
+        if (r.state == RECORD_DELIVERED) {
+          queue.count--;
+          flips++;
+        }
+      }
+      FREE(payload);
+      if (stop)
+        break;
+
+      /* The replay position moves over the leading delivered records */
+      if (r.state != RECORD_DELIVERED)
+        leading = FALSE;
+      else if (leading) {
+        head     = seq;
+        position = next;
+      }
+      offset = next;
+    }
+
+    if (flips) {
+      delivered = TRUE;
+      fflush(file);
+      fsync(fileno(file));
+    }
+    fclose(file);
+
+    /* All records of an inactive segment were delivered (or lost) */
+    if (leading && ! stop && seq < end) {
+      if (unlink(path) < 0)
+        LogError("%s: cannot remove the event queue segment %s -- %s\n", prog, path, STRERROR);
+      head     = seq + 1;
+      position = 0;
+    }
+  }
+
+  queue.head     = head;
+  queue.position = position;
+  if (delivered)
+    compact();
+  save_index();
+}
+
+
+void Queue_close() {
+  if (queue.fd >= 0)
+    close(queue.fd);
+  queue.fd = -1;
+  queue.count = 0;
+  FREE(queue.dir);
+}
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+/**
+ * Open the queue in the Run.eventlist_dir directory, read the replay
+ * position from the index and count the pending records. The queue
+ * is reopened if the directory was changed by reload. The events
+ * queued by an older Monit version, one file per event named by the
+ * time and the service address, are imported into the log.
+ * @return TRUE if the queue is open, otherwise FALSE
+ */
+static int open_queue() {
+  int            found = FALSE;
+  int            old = FALSE;
+  unsigned int   first = 0;
+  unsigned int   last = 0;
+  unsigned int   head = 0;
+  long           position = 0;
+  char           path[STRLEN];
+  FILE          *file;
+  DIR           *dir;
+  struct dirent *de;
+
+  if (queue.dir && IS(queue.dir, Run.eventlist_dir))
+    return TRUE;
+  Queue_close();
+
+  if (! File_checkQueueDirectory(Run.eventlist_dir, 0700)) {
+    LogError("%s: Aborting event - cannot access the directory %s\n", prog, Run.eventlist_dir);
+    return FALSE;
+  }
+  if (! (dir = opendir(Run.eventlist_dir))) {
+    LogError("%s: cannot open the directory %s -- %s\n", prog, Run.eventlist_dir, STRERROR);
+    return FALSE;
+  }
+  while ((de = readdir(dir))) {
+    unsigned int seq;
+    int          n = 0;
+
+    if (sscanf(de->d_name, "%8x.seg%n", &seq, &n) == 1 && n && ! de->d_name[n]) {
+      if (! found || seq < first)
+        first = seq;
+      if (! found || seq > last)
+        last = seq;
+      found = TRUE;
+    } else if (is_legacy(de->d_name))
+      old = TRUE;
+  }
+  closedir(dir);
+
+  snprintf(path, sizeof(path), "%s/index", Run.eventlist_dir);
+  if ((file = fopen(path, "r"))) {
+    if (fscanf(file, "%x %ld", &head, &position) != 2)
+      head = 0;
+    fclose(file);
+  }
+
+  if (found) {
+    if (head < first || head > last) {
+      head     = first;
+      position = 0;
+    }
+    queue.head     = head;
+    queue.position = position;
+    queue.tail     = last + 1;
+  } else {
+    queue.head = queue.tail = 1;
+    queue.position = 0;
+  }
+  queue.size  = 0;
+  queue.fd    = -1;
+  queue.count = found ? count_pending(last) : 0;
+  queue.dir   = xstrdup(Run.eventlist_dir);
+
+  DEBUG("%s: event queue %s opened with %d pending events\n", prog, queue.dir, queue.count);
+  if (old)
+    import_legacy();
+  return TRUE;
+}
+
+
+/**
+ * Test if the file name is a queued event of an older Monit version,
+ * <time>_<service address>
+ */
+static int is_legacy(const char *name) {
+  int n = 0;
+
+  return sscanf(name, "%*[0-9]_%*[0-9a-f]%n", &n) == 0 && n && ! name[n];
+}
+
+
+/**
+ * Import the events queued by an older Monit version into the log in
+ * the order they were queued. An event file is removed only after its
+ * record was flushed to the disk. The files which can't be imported
+ * are left in the directory, the import stops at the first failed
+ * append (e.g. the queue is full) and is retried when the queue is
+ * opened again.
+ */
+static void import_legacy() {
+  int            i;
+  int            count = 0;
+  int            imported = 0;
+  int            failed = FALSE;
+  char         **names = NULL;
+  DIR           *dir;
+  struct dirent *de;
+
+  if (! (dir = opendir(queue.dir))) {
+    LogError("%s: cannot open the directory %s -- %s\n", prog, queue.dir, STRERROR);
+    return;
+  }
+  while ((de = readdir(dir)))
+    if (is_legacy(de->d_name)) {
+      if (! (count & (count - 1)))
+        names = xresize(names, (count ? 2 * count : 1) * sizeof(char *));
+      names[count++] = xstrdup(de->d_name);
+    }
+  closedir(dir);
+  qsort(names, count, sizeof(char *), compare_names);
+
+  for (i = 0; i < count; i++) {
+    char    path[STRLEN];
+    Event_T e;
+
+    snprintf(path, sizeof(path), "%s/%s", queue.dir, names[i]);
+    FREE(names[i]);
+    if (failed)
+      continue;
+    if (! (e = read_legacy(path)))
+      continue;
+    if (Queue_add(e)) {
+      imported++;
+      if (unlink(path) < 0)
+        LogError("%s: cannot remove the imported event file %s, it will be imported again -- %s\n", prog, path, STRERROR);
+    } else
+      failed = TRUE;
+    free_event(e);
+  }
+  FREE(names);
+
+  if (imported)
+    LogInfo("%s: imported %d events queued by an older Monit version in %s\n", prog, imported, queue.dir);
+  if (imported < count)
+    LogError("%s: %d events queued by an older Monit version were not imported, the files are kept in %s\n", prog, count - imported, queue.dir);
+}
+
+
+/**
+ * Read the event file queued by an older Monit version. The file is
+ * a sequence of items, each of them a size followed by the data: the
+ * event structure version, the event, source, message and action.
+ * @param path The event file
+ * @return The event or NULL if the file can't be read
+ */
+static Event_T read_legacy(const char *path) {
+  int                size;
+  int               *version = NULL;
+  short             *action = NULL;
+  char              *source = NULL;
+  char              *message = NULL;
+  struct myevent_v3 *old = NULL;
+  Event_T            e = NULL;
+  Action_T           a;
+  FILE              *file;
+
+  if (! (file = fopen(path, "r"))) {
+    LogError("%s: cannot open the queued event %s -- %s\n", prog, path, STRERROR);
+    return NULL;
+  }
+  if (! (version = read_legacy_item(file, &size)) || size != sizeof(int) || *version != LEGACY_VERSION) {
+    LogError("%s: cannot import the queued event %s - incompatible data format version %d\n", prog, path, version && size == sizeof(int) ? *version : -1);
+    goto error;
+  }
+  if (! (old = read_legacy_item(file, &size)) || size != sizeof(*old) ||
+      ! (source = read_legacy_item(file, &size)) || ! size || source[size - 1] ||
+      (! (message = read_legacy_item(file, &size)) && size) || (size && message[size - 1]) ||
+      ! (action = read_legacy_item(file, &size)) || size != sizeof(short)) {
+    LogError("%s: cannot import the queued event %s - the file is truncated or corrupted\n", prog, path);
+    goto error;
+  }
+
+  NEW(e);
+  e->id            = old->id;
+  e->collected     = old->collected;
+  e->mode          = old->mode;
+  e->type          = old->type;
+  e->state         = old->state;
+  e->state_changed = old->state_changed;
+  e->state_map     = old->state_map;
+  e->count         = old->count;
+  e->flag          = old->flag;
+  e->source        = source;
+  e->message       = message;
+  source = message = NULL;
+  NEW(e->action);
+  NEW(a);
+  a->id = *action;
+  e->action->failed = e->action->succeeded = a;
+
+  error:
+  fclose(file);
+  FREE(version);
+  FREE(old);
+  FREE(source);
+  FREE(message);
+  FREE(action);
+  return e;
+}
+
+
+/**
+ * Read the next item of the event file queued by an older Monit
+ * version, a size followed by the data
+ * @param file The event file
+ * @param size The item size
+ * @return The item data or NULL if the item is empty or can't be read
+ */
+static void *read_legacy_item(FILE *file, int *size) {
+  void *data;
+
+  if (fread(size, 1, sizeof(int), file) != sizeof(int) || *size < 0 || *size >= QUEUE_RECORD_SIZE) {
+    *size = -1;
+    return NULL;
+  }
+  if (! *size)
+    return NULL;
+  data = xmalloc(*size);
+  if (fread(data, 1, *size, file) != (size_t)*size) {
+    FREE(data);
+    *size = -1;
+  }
+  return data;
+}
+
+
+/**
+ * Order the event file names, they start with the time the event was
+ * queued
+ */
+static int compare_names(const void *a, const void *b) {
+  return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+
+/**
+ * Compose the path of the segment file
+ */
+static char *segment_path(unsigned int seq, char *buf, int size) {
+  snprintf(buf, size, "%s/%08x.seg", queue.dir ? queue.dir : Run.eventlist_dir, seq);
+  return buf;
+}
+
+
+/**
+ * Read the record at the current position of the segment file
+ * @param file The segment file
+ * @param r The record header
+ * @param payload The payload, it must be freed by the caller
+ * @return 1 if the record was read, 0 at the end of the segment and
+ * -1 if the record is invalid (e.g. torn by a crash)
+ */
+static int read_record(FILE *file, struct myrecord *r, char **payload) {
+  size_t n;
+
+  *payload = NULL;
+  if ((n = fread(r, 1, sizeof(*r), file)) != sizeof(*r))
+    return n ? -1 : 0;
+  if (r->magic != QUEUE_MAGIC || r->length == 0 || r->length > QUEUE_RECORD_SIZE || (r->state != RECORD_PENDING && r->state != RECORD_DELIVERED))
+    return -1;
+  *payload = xmalloc(r->length);
+  if (fread(*payload, 1, r->length, file) != r->length || checksum_crc32(*payload, r->length) != r->crc) {
+    FREE(*payload);
+    return -1;
+  }
+  return 1;
+}
+
+
+/**
+ * Append the record to the active segment and flush it to the disk.
+ * If the write fails, the segment is truncated back and the next
+ * record starts a new segment.
+ * @param payload The record payload
+ * @param length The payload length
+ * @return TRUE if succeeded otherwise FALSE
+ */
+static int append_record(const char *payload, unsigned int length) {
+  char            *buf;
+  char             path[STRLEN];
+  long             total = sizeof(struct myrecord) + length;
+  long             done = 0;
+  struct myrecord  r;
+
+  if (queue.fd >= 0 && queue.size > 0 && queue.size + total > QUEUE_SEGMENT_SIZE) {
+    close(queue.fd);
+    queue.fd = -1;
+    queue.tail++;
+    queue.size = 0;
+  }
+  if (queue.fd < 0) {
+    mode_t mask = umask(QUEUEMASK);
+    queue.fd = open(segment_path(queue.tail, path, sizeof(path)), O_WRONLY|O_CREAT|O_APPEND, 0600);
+    umask(mask);
+    if (queue.fd < 0) {
+      LogError("%s: Aborting event - cannot open the event queue segment %s -- %s\n", prog, path, STRERROR);
+      return FALSE;
+    }
+    fcntl(queue.fd, F_SETFD, FD_CLOEXEC);
+    queue.size = lseek(queue.fd, 0, SEEK_END);
+  }
+
+  r.magic  = QUEUE_MAGIC;
+  r.length = length;
+  r.crc    = checksum_crc32(payload, length);
+  r.state  = RECORD_PENDING;
+  buf = xmalloc(total);
+  memcpy(buf, &r, sizeof(r));
+  memcpy(buf + sizeof(r), payload, length);
+  while (done < total) {
+    ssize_t n = write(queue.fd, buf + done, total - done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    done += n;
+  }
+  FREE(buf);
+
+  if (done < total || fsync(queue.fd) < 0) {
+    LogError("%s: Aborting event - unable to write to the event queue segment %s -- %s\n", prog, segment_path(queue.tail, path, sizeof(path)), STRERROR);
+    if (ftruncate(queue.fd, queue.size) < 0)
+      DEBUG("%s: cannot truncate the event queue segment %s -- %s\n", prog, path, STRERROR);
+    close(queue.fd);
+    queue.fd = -1;
+    queue.tail++;
+    queue.size = 0;
+    return FALSE;
+  }
+  queue.size += total;
+  queue.count++;
+  return TRUE;
+}
+
+
+/**
+ * Mark the record as delivered, the state word is the only part of a
+ * record which is written in place
+ * @param file The segment file
+ * @param offset The record offset
+ * @return TRUE if succeeded otherwise FALSE
+ */
+static int mark_delivered(FILE *file, long offset) {
+  unsigned int state = RECORD_DELIVERED;
+
+  if (pwrite(fileno(file), &state, sizeof(state), offset + offsetof(struct myrecord, state)) != sizeof(state)) {
+    LogError("%s: cannot update the event queue record -- %s\n", prog, STRERROR);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+
+/**
+ * Count the pending records from the replay position to the end of
+ * the last segment. A torn record left by a crash is cut off, so it
+ * is reported just once.
+ * @param last The last segment
+ * @return The number of pending records
+ */
+static int count_pending(unsigned int last) {
+  int          count = 0;
+  unsigned int seq;
+
+  for (seq = queue.head; seq <= last; seq++) {
+    FILE            *file;
+    char            *payload;
+    char             path[STRLEN];
+    long             offset = (seq == queue.head) ? queue.position : 0;
+    int              rv;
+    struct myrecord  r;
+
+    if (! (file = fopen(segment_path(seq, path, sizeof(path)), "r+")))
+      continue;
+    if (fseek(file, offset, SEEK_SET) == 0) {
+      while ((rv = read_record(file, &r, &payload)) > 0) {
+        if (r.state == RECORD_PENDING)
+          count++;
+        offset += sizeof(r) + r.length;
+        FREE(payload);
+      }
+      if (rv < 0) {
+        LogError("%s: event queue segment %s is corrupted at offset %ld, the rest of the segment is dropped\n", prog, path, offset);
+        if (ftruncate(fileno(file), offset) < 0)
+          LogError("%s: cannot truncate the event queue segment %s -- %s\n", prog, path, STRERROR);
+      }
+    }
+    fclose(file);
+  }
+  return count;
+}
+
+
+/**
+ * Compact the inactive segments which hold less than a quarter of
+ * pending data. Their pending records are moved to the active segment
+ * and the segment is removed. A moved record lands in a segment with
+ * at most a quarter of pending data, so the records are not moved
+ * back and forth while the handlers are failing.
+ */
+static void compact() {
+  unsigned int seq;
+  unsigned int end = queue.tail;
+
+  for (seq = queue.head; seq < end; seq++) {
+    FILE            *file;
+    char            *payload;
+    char             path[STRLEN];
+    long             pending = 0;
+    long             offset = 0;
+    int              failed = FALSE;
+    struct stat      st;
+    struct myrecord  r;
+
+    if (! (file = fopen(segment_path(seq, path, sizeof(path)), "r+")))
+      continue;
+    if (fstat(fileno(file), &st) < 0) {
+      fclose(file);
+      continue;
+    }
+    while (read_record(file, &r, &payload) > 0) {
+      if (r.state == RECORD_PENDING)
+        pending += sizeof(r) + r.length;
+      FREE(payload);
+    }
+    if (pending * 4 >= st.st_size) {
+      fclose(file);
+      continue;
+    }
+
+    DEBUG("%s: compacting the event queue segment %s\n", prog, path);
+    rewind(file);
+    while (! failed && read_record(file, &r, &payload) > 0) {
+      if (r.state == RECORD_PENDING) {
+        if (append_record(payload, r.length) && mark_delivered(file, offset))
+          queue.count--;
+        else
+          failed = TRUE;
+      }
+      offset += sizeof(r) + r.length;
+      FREE(payload);
+    }
+    fsync(fileno(file));
+    fclose(file);
+    if (failed)
+      break;
+    if (unlink(path) < 0)
+      LogError("%s: cannot remove the event queue segment %s -- %s\n", prog, path, STRERROR);
+    if (seq == queue.head) {
+      queue.head     = seq + 1;
+      queue.position = 0;
+    }
+  }
+}
+
+
+/**
+ * Save the replay position atomically
+ */
+static void save_index() {
+  FILE   *file;
+  char    path[STRLEN];
+  char    tmp[STRLEN];
+  mode_t  mask;
+
+  snprintf(path, sizeof(path), "%s/index", queue.dir);
+  snprintf(tmp, sizeof(tmp), "%s/index.tmp", queue.dir);
+  mask = umask(QUEUEMASK);
+  file = fopen(tmp, "w");
+  umask(mask);
+  if (! file) {
+    LogError("%s: cannot write the event queue index %s -- %s\n", prog, tmp, STRERROR);
+    return;
+  }
+  fprintf(file, "%08x %ld\n", queue.head, queue.position);
+  if (fflush(file) || fsync(fileno(file)) < 0 || fclose(file) || rename(tmp, path) < 0) {
+    LogError("%s: cannot write the event queue index %s -- %s\n", prog, path, STRERROR);
+    unlink(tmp);
+  }
+}
+
+
+/**
+ * Serialize the event into the record payload
+ * @param E An event object
+ * @param length The payload length
+ * @return The payload, it must be freed by the caller
+ */
+static char *serialize(Event_T E, unsigned int *length) {
+  int    version = EVENT_VERSION;
+  int    size = sizeof(*E);
+  short  action = Event_get_action(E);
+  int    sourcelen = E->source ? strlen(E->source) + 1 : 0;
+  int    messagelen = E->message ? strlen(E->message) + 1 : 0;
+  char  *payload;
+  char  *p;
+
+  *length = 3 * sizeof(int) + sizeof(*E) + sizeof(short) + sizeof(int) + sourcelen + messagelen;
+  p = payload = xmalloc(*length);
+  memcpy(p, &version, sizeof(int));     p += sizeof(int);
+  memcpy(p, &size, sizeof(int));        p += sizeof(int);
+  memcpy(p, E, sizeof(*E));             p += sizeof(*E);
+  memcpy(p, &action, sizeof(short));    p += sizeof(short);
+  memcpy(p, &sourcelen, sizeof(int));   p += sizeof(int);
+  memcpy(p, E->source, sourcelen);      p += sourcelen;
+  memcpy(p, &messagelen, sizeof(int));  p += sizeof(int);
+  memcpy(p, E->message, messagelen);
+  return payload;
+}
+
+
+/**
+ * Read the event from the record payload. The event gets its own
+ * action object with the queued action.
+ * @param payload The record payload
+ * @param length The payload length
+ * @return The event or NULL if the payload has an incompatible format
+ */
+static Event_T deserialize(const char *payload, unsigned int length) {
+  int            version;
+  int            size;
+  int            sourcelen;
+  int            messagelen;
+  short          action;
+  const char    *p = payload;
+  const char    *end = payload + length;
+  Event_T        e;
+  Action_T       a;
+
+  if (length < 2 * sizeof(int))
+    return NULL;
+  memcpy(&version, p, sizeof(int));     p += sizeof(int);
+  memcpy(&size, p, sizeof(int));        p += sizeof(int);
+  if (version != EVENT_VERSION || size != sizeof(*e) || end - p < (long)(sizeof(*e) + sizeof(short) + sizeof(int)))
+    return NULL;
+
+  NEW(e);
+  memcpy(e, p, sizeof(*e));             p += sizeof(*e);
+  memcpy(&action, p, sizeof(short));    p += sizeof(short);
+  memcpy(&sourcelen, p, sizeof(int));   p += sizeof(int);
+  e->source   = NULL;
+  e->message  = NULL;
+  e->action   = NULL;
+  e->service  = NULL;
+  e->next     = NULL;
+  e->previous = NULL;
+  if (sourcelen <= 0 || end - p < sourcelen + (long)sizeof(int) || p[sourcelen - 1])
+    goto error;
+  e->source = xstrdup(p);               p += sourcelen;
+  memcpy(&messagelen, p, sizeof(int));  p += sizeof(int);
+  if (messagelen < 0 || end - p < messagelen || (messagelen && p[messagelen - 1]))
+    goto error;
+  if (messagelen)
+    e->message = xstrdup(p);
+
+  NEW(e->action);
+  NEW(a);
+  a->id = action;
+  e->action->failed = e->action->succeeded = a;
+  return e;
+
+  error:
+  free_event(e);
+  return NULL;
+}
+
+
+/**
+ * Free the event read from the queue
+ */
+static void free_event(Event_T e) {
+  if (e->action) {
+    FREE(e->action->failed);
+    FREE(e->action);
+  }
+  FREE(e->source);
+  FREE(e->message);
+  FREE(e);
+}
+
+
+/**
+ * Compute the CRC-32 (IEEE 802.3) of the data
+ */
+static unsigned int checksum_crc32(const char *data, unsigned int length) {
+  unsigned int i;
+  unsigned int crc = 0xFFFFFFFF;
+
+  if (! crcTable[1]) {
+    for (i = 0; i < 256; i++) {
+      int          k;
+      unsigned int c = i;
+
+      for (k = 0; k < 8; k++)
+        c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      crcTable[i] = c;
+    }
+  }
+  for (i = 0; i < length; i++)
+    crc = crcTable[(crc ^ (unsigned char)data[i]) & 0xff] ^ (crc >> 8);
+  return crc ^ 0xFFFFFFFF;
+}
+
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2011 Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+
+
+#ifndef MONIT_QUEUE_H
+#define MONIT_QUEUE_H
+
+
+/**
+ *  Persistent event queue - an append-only log of the partially
+ *  handled events, split into segment files in the event queue
+ *  directory. Every record carries a CRC-32 of its content and a
+ *  state word which is the only part ever rewritten in place, from
+ *  pending to done. A small index file keeps the replay position,
+ *  the first record which may still be pending, so the delivered
+ *  records are not read again. The segments whose records were all
+ *  delivered are removed and the mostly delivered ones are compacted
+ *  by moving their pending records to the active segment.
+ *
+ *  The number of pending records is counted in memory, so the slot
+ *  limit check doesn't need to scan the directory.
+ *
+ *  @file
+ */
+
+
+/** Results of the replay handler */
+#define QUEUE_KEEP    0        /**< The event is pending, keep the record */
+#define QUEUE_UPDATE  1  /**< Some handlers passed, store the updated event */
+#define QUEUE_DONE    2           /**< The event was delivered, drop it */
+#define QUEUE_STOP    3       /**< Stop the replay, the event was not used */
+
+
+/**
+ * Append the event to the queue. The record is flushed to the disk
+ * before the function returns.
+ * @param E An event object
+ * @return TRUE if the event was stored, FALSE if the queue is not
+ * accessible, full or the write failed
+ */
+int Queue_add(Event_T E);
+
+
+/**
+ * Replay the pending events from the saved position in the order
+ * they were added. The handler gets an event read from the queue, the
+ * event is freed after the handler returned. An updated event is
+ * appended to the queue again and the original record is dropped.
+ * Afterwards the delivered segments are removed or compacted and the
+ * new replay position is saved.
+ * @param handler The function handling the event, it returns one of
+ * QUEUE_KEEP, QUEUE_UPDATE, QUEUE_DONE or QUEUE_STOP
+ */
+void Queue_replay(int (*handler)(Event_T));
+
+
+/**
+ * Close the queue files. The queue is opened again on the next use,
+ * for example in a new event queue directory after reload.
+ */
+void Queue_close();
+
+
+#endif
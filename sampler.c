@@ -0,0 +1,357 @@
+/*
+ * Copyright (C) 2011 Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+
+
+#include <config.h>
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef TIME_WITH_SYS_TIME
+#include <time.h>
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#else
+#include <time.h>
+#endif
+
+#include "monitor.h"
+#include "process.h"
+#include "process_sysdep.h"
+#include "sampler.h"
+
+
+/**
+ *  Sample the CPU usage of the system and of the monitored processes
+ *  into per-service ring buffers at a sub-second interval.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+/* Default sampler interval [ms] */
+#define SAMPLER_INTERVAL 1000
+
+
+static struct mysampler {
+  int             running;                /**< TRUE if the sampler is running */
+  int             interval;                       /**< Sampler interval [ms] */
+  pthread_t       thread;                              /**< Sampler thread */
+} sampler;
+
+static pthread_mutex_t samplerMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  samplerCond  = PTHREAD_COND_INITIALIZER;
+
+
+/* -------------------------------------------------------------- Prototypes */
+
+
+static int  get_metric(int);
+static int  compare_samples(const void *, const void *);
+#ifdef HAVE_SAMPLER
+static void sample_services(void);
+static void *sample_thread(void *);
+#endif
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void Sampler_start() {
+  Service_T s;
+  int       used = FALSE;
+
+  if (sampler.running)
+    return;
+  sampler.interval = Run.sampleinterval ? Run.sampleinterval : SAMPLER_INTERVAL;
+
+  for (s = servicelist; s; s = s->next) {
+    Resource_T r;
+    int        window = 0;
+
+    for (r = s->resourcelist; r; r = r->next)
+      if (r->statistic != SAMPLE_NONE && r->window > window)
+        window = r->window;
+    if (! window)
+      continue;
+
+    /* The window may start in the middle of an interval => one more sample */
+    if (! s->sample) {
+      NEW(s->sample);
+      s->sample->size = (int)((window * 1000LL) / sampler.interval) + 1;
+      for (r = s->resourcelist; r; r = r->next)
+        if (r->statistic != SAMPLE_NONE && ! s->sample->ring[get_metric(r->resource_id)])
+          s->sample->ring[get_metric(r->resource_id)] = xcalloc(sizeof(int), s->sample->size);
+    }
+    used = TRUE;
+  }
+  if (! used)
+    return;
+
+#ifdef HAVE_SAMPLER
+  {
+    int status;
+
+    sampler.running = TRUE;
+    if ((status = pthread_create(&sampler.thread, NULL, sample_thread, NULL)) != 0) {
+      LogError("%s: Failed to create the sampler thread -- %s\n", prog, strerror(status));
+      sampler.running = FALSE;
+    }
+  }
+#endif
+}
+
+
+void Sampler_stop() {
+  int status;
+
+  if (! sampler.running)
+    return;
+  LOCK(samplerMutex)
+  {
+    sampler.running = FALSE;
+    pthread_cond_signal(&samplerCond);
+  }
+  END_LOCK;
+  if ((status = pthread_join(sampler.thread, NULL)) != 0)
+    LogError("%s: Failed to stop the sampler thread -- %s\n", prog, strerror(status));
+}
+
+
+int Sampler_getStatistic(Service_T s, Resource_T r, int *value) {
+  int  i;
+  int  n;
+  int *ring;
+  int  rv = FALSE;
+
+  ASSERT(s);
+  ASSERT(r);
+  ASSERT(value);
+
+  if (! s->sample || ! (ring = s->sample->ring[get_metric(r->resource_id)]))
+    return FALSE;
+
+  LOCK(samplerMutex)
+  {
+    Sample_T p = s->sample;
+
+    n = (int)((r->window * 1000LL) / sampler.interval) + 1;
+    if (n > p->count)
+      n = p->count;
+    if (n > 0) {
+      /* The samples in the window, the newest one is at next - 1 */
+      int *samples = xcalloc(sizeof(int), n);
+      for (i = 0; i < n; i++)
+        samples[i] = ring[(p->next - 1 - i + p->size) % p->size];
+
+      switch (r->statistic) {
+        case SAMPLE_AVERAGE:
+          {
+            long long sum = 0;
+            for (i = 0; i < n; i++)
+              sum += samples[i];
+            *value = (int)(sum / n);
+          }
+          break;
+        case SAMPLE_MAXIMUM:
+          for (*value = samples[0], i = 1; i < n; i++)
+            if (samples[i] > *value)
+              *value = samples[i];
+          break;
+        case SAMPLE_PERCENTILE:
+          /* Nearest rank */
+          qsort(samples, n, sizeof(int), compare_samples);
+          i = (r->percentile * n + 99) / 100;
+          *value = samples[i > 0 ? i - 1 : 0];
+          break;
+      }
+      FREE(samples);
+      rv = TRUE;
+    }
+  }
+  END_LOCK;
+
+  return rv;
+}
+
+
+char *Sampler_describe(Resource_T r, char *buf, int bufsize) {
+
+  ASSERT(r);
+  ASSERT(buf);
+
+  switch (r->statistic) {
+    case SAMPLE_AVERAGE:
+      snprintf(buf, bufsize, " average within %d s", r->window);
+      break;
+    case SAMPLE_MAXIMUM:
+      snprintf(buf, bufsize, " maximum within %d s", r->window);
+      break;
+    case SAMPLE_PERCENTILE:
+      snprintf(buf, bufsize, " percentile %d within %d s", r->percentile, r->window);
+      break;
+    default:
+      *buf = 0;
+      break;
+  }
+  return buf;
+}
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+/**
+ * Get the sampled metric of the resource test
+ * @param resource_id The resource id
+ * @return The metric
+ */
+static int get_metric(int resource_id) {
+  switch (resource_id) {
+    case RESOURCE_ID_CPUUSER:   return SAMPLE_CPUUSER;
+    case RESOURCE_ID_CPUSYSTEM: return SAMPLE_CPUSYSTEM;
+    case RESOURCE_ID_CPUWAIT:   return SAMPLE_CPUWAIT;
+    default:                    return SAMPLE_CPU;
+  }
+}
+
+
+/**
+ * Compare two samples for qsort()
+ */
+static int compare_samples(const void *a, const void *b) {
+  return *(const int *)a - *(const int *)b;
+}
+
+
+#ifdef HAVE_SAMPLER
+/**
+ * Take one sample of every sampled service. The process CPU usage is
+ * computed the same way as by the process tree update, from the CPU
+ * time delta since the previous sample. A process which is not running
+ * or which was just (re)started doesn't get a sample.
+ */
+static void sample_services() {
+  Service_T s;
+  int       cpu[SAMPLE_METRICS];
+  int       system;
+  double    now = get_float_time();
+
+  system = sample_system_cpu_sysdep(&cpu[SAMPLE_CPUUSER], &cpu[SAMPLE_CPUSYSTEM], &cpu[SAMPLE_CPUWAIT]);
+
+  for (s = servicelist; s; s = s->next) {
+    int      i;
+    Sample_T p = s->sample;
+
+    if (! p)
+      continue;
+
+    if (s->type == TYPE_SYSTEM) {
+      if (! system)
+        continue;
+    } else {
+      int    pid = s->inf->priv.process.pid;
+      double cputime = 0;
+
+      if (pid <= 0 || ! sample_process_cpu_sysdep(pid, &cputime)) {
+        p->pid = 0;
+        continue;
+      }
+      if (pid != p->pid || cputime < p->cputime || now <= p->time) {
+        p->pid     = pid;
+        p->cputime = cputime;
+        p->time    = now;
+        continue;
+      }
+      cpu[SAMPLE_CPU] = (int)((1000 * (cputime - p->cputime) / (now - p->time)) / systeminfo.cpus);
+      if (cpu[SAMPLE_CPU] > 1000 / systeminfo.cpus)
+        cpu[SAMPLE_CPU] = 1000 / systeminfo.cpus;
+      p->cputime = cputime;
+      p->time    = now;
+    }
+
+    for (i = 0; i < SAMPLE_METRICS; i++)
+      if (p->ring[i])
+        p->ring[i][p->next] = cpu[i];
+    p->next = (p->next + 1) % p->size;
+    if (p->count < p->size)
+      p->count++;
+  }
+}
+
+
+/**
+ * The sampler thread - takes a sample every interval until stopped
+ * @param args Not used
+ */
+static void *sample_thread(void *args) {
+  sigset_t        ns;
+  struct timeval  t;
+  struct timespec wait;
+
+  set_signal_block(&ns, NULL);
+  DEBUG("%s: sampler started with interval %d ms\n", prog, sampler.interval);
+  LOCK(samplerMutex)
+  {
+    while (sampler.running) {
+      sample_services();
+      gettimeofday(&t, NULL);
+      wait.tv_sec  = t.tv_sec + sampler.interval / 1000;
+      wait.tv_nsec = t.tv_usec * 1000L + (sampler.interval % 1000) * 1000000L;
+      if (wait.tv_nsec >= 1000000000L) {
+        wait.tv_sec++;
+        wait.tv_nsec -= 1000000000L;
+      }
+      pthread_cond_timedwait(&samplerCond, &samplerMutex, &wait);
+    }
+  }
+  END_LOCK;
+  DEBUG("%s: sampler stopped\n", prog);
+  return NULL;
+}
+#endif
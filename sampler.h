@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2011 Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+
+
+#ifndef MONIT_SAMPLER_H
+#define MONIT_SAMPLER_H
+
+
+/**
+ *  Sample the CPU usage at a sub-second interval. The sampler thread
+ *  reads the system CPU counters and the CPU time of the monitored
+ *  processes into per-service ring buffers. Resource tests with a
+ *  statistic, such as "if cpu maximum within 10 seconds > 90%",
+ *  evaluate the average, maximum or percentile of the samples in the
+ *  given window instead of the delta between two poll cycles.
+ *
+ *  The sampler runs only if some resource test uses a statistic, the
+ *  default interval is one second, it can be changed by the "set
+ *  sampler" statement.
+ *
+ *  @file
+ */
+
+
+/**
+ * Allocate the ring buffers of the services using a sampled resource
+ * test and start the sampler thread. Does nothing if no service uses
+ * a sampled resource test.
+ */
+void Sampler_start();
+
+
+/**
+ * Stop the sampler thread. The ring buffers are kept, they are freed
+ * with the service.
+ */
+void Sampler_stop();
+
+
+/**
+ * Get the statistic of the samples in the window of the resource test
+ * @param s The service
+ * @param r The resource test with a statistic
+ * @param value The statistic of the samples [percent * 10]
+ * @return TRUE if succeeded, FALSE if no samples are available yet
+ */
+int Sampler_getStatistic(Service_T s, Resource_T r, int *value);
+
+
+/**
+ * Describe the statistic of the resource test, for example " maximum
+ * within 10 s". An empty string is returned if the resource test
+ * doesn't use a statistic.
+ * @param r The resource test
+ * @param buf The buffer to write the description to
+ * @param bufsize The size of the buffer
+ * @return The buffer
+ */
+char *Sampler_describe(Resource_T r, char *buf, int bufsize);
+
+
+#endif
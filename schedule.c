@@ -0,0 +1,347 @@
+/*
+ * Copyright (C) 2011 Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+
+
+#include <config.h>
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_LIMITS_H
+#include <limits.h>
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
+#ifdef TIME_WITH_SYS_TIME
+#include <time.h>
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#else
+#include <time.h>
+#endif
+
+#include "monitor.h"
+#include "schedule.h"
+
+
+/**
+ *  Per-service check scheduler - a binary min-heap of the services
+ *  ordered by the next check deadline.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+static struct myschedule {
+  Service_T *heap;                 /**< Services ordered by the deadline */
+  int        count;                        /**< Number of heap entries */
+  int        wakeup;                /**< TRUE if all services are due */
+} schedule;
+
+static struct mywakeup {
+  int ready;                        /**< TRUE if the descriptors are open */
+  int fd[2];   /**< Read and write end, the same descriptor for eventfd */
+  int threadready;           /**< TRUE if the thread descriptors are open */
+  int thread[2];             /**< Wakeup descriptors of the helper thread */
+} wakeup;
+
+
+/* -------------------------------------------------------------- Prototypes */
+
+
+static long long get_time(void);
+static void      sift_down(int);
+static void      init_wakeup(void);
+static int       open_wakeup(int fd[2]);
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void Schedule_init() {
+  int       i;
+  long long now = get_time();
+  Service_T s;
+
+  Schedule_free();
+  if (! wakeup.ready)
+    init_wakeup();
+  for (s = servicelist; s; s = s->next)
+    schedule.count++;
+  schedule.heap = xcalloc(sizeof(Service_T), schedule.count ? schedule.count : 1);
+
+  for (i = 0, s = servicelist; s; s = s->next, i++) {
+    if (s->interval)
+      s->period = s->interval;
+    else
+      s->period = (long long)(s->def_every ? s->every : 1) * Run.polltime * 1000;
+    /* Random phase within the second half of the period */
+    s->deadline = now + s->period / 2 + random() % (s->period / 2 + 1);
+    schedule.heap[i] = s;
+  }
+  for (i = schedule.count / 2 - 1; i >= 0; i--)
+    sift_down(i);
+  schedule.wakeup = TRUE;
+}
+
+
+void Schedule_free() {
+  FREE(schedule.heap);
+  schedule.count = 0;
+}
+
+
+int Schedule_update() {
+  int       process = FALSE;
+  long long now = get_time();
+  Service_T s;
+
+  if (! schedule.heap || schedule.wakeup) {
+    for (s = servicelist; s; s = s->next) {
+      s->due    = TRUE;
+      s->exited = FALSE;
+    }
+    schedule.wakeup = FALSE;
+    return TRUE;
+  }
+
+  while (schedule.count && (s = schedule.heap[0])->deadline <= now) {
+    s->due = TRUE;
+    /* Keep the phase, a deadline which was missed completely is skipped */
+    s->deadline += s->period;
+    if (s->deadline <= now)
+      s->deadline = now + s->period;
+    sift_down(0);
+  }
+  for (s = servicelist; s; s = s->next) {
+    /* The process exit watcher flags the service whose process exited */
+    if (s->exited) {
+      s->exited = FALSE;
+      s->due    = TRUE;
+    }
+    if (s->due && (s->type == TYPE_PROCESS || s->type == TYPE_SYSTEM))
+      process = TRUE;
+  }
+  return process;
+}
+
+
+void Schedule_wakeup() {
+  schedule.wakeup = TRUE;
+}
+
+
+void Schedule_sleep() {
+  long long       wait = Run.polltime * 1000LL;
+  struct timespec t;
+
+  if (schedule.wakeup)
+    return;
+  if (schedule.count && (wait = schedule.heap[0]->deadline - get_time()) <= 0)
+    return;
+
+  if (wakeup.ready) {
+    char          buf[64];
+    struct pollfd fds[1];
+
+    fds[0].fd     = wakeup.fd[0];
+    fds[0].events = POLLIN;
+    /* A signal interrupts the wait too, the flag it sets is checked by the caller */
+    if (poll(fds, 1, (int)(wait < INT_MAX ? wait : INT_MAX)) > 0)
+      while (read(wakeup.fd[0], buf, sizeof(buf)) > 0)
+        ;
+    return;
+  }
+
+  t.tv_sec  = wait / 1000;
+  t.tv_nsec = (wait % 1000) * 1000000L;
+  /* A signal (wakeup, reload, stop) interrupts the sleep */
+  nanosleep(&t, NULL);
+}
+
+
+void Schedule_notify() {
+  int                saved = errno;
+  unsigned long long one = 1;
+
+  /* A full pipe is readable already => the error is ignored, no logging in the signal handler */
+  if (wakeup.ready)
+    (void)write(wakeup.fd[1], &one, sizeof(one));
+  if (wakeup.threadready)
+    (void)write(wakeup.thread[1], &one, sizeof(one));
+  errno = saved;
+}
+
+
+void Schedule_wait(int timeout) {
+  long long wait;
+  long long deadline = get_time() + timeout;
+
+  while (! Run.stopped && ! Run.doreload && (wait = deadline - get_time()) > 0) {
+    if (wakeup.threadready) {
+      char          buf[64];
+      struct pollfd fds[1];
+
+      fds[0].fd     = wakeup.thread[0];
+      fds[0].events = POLLIN;
+      /* Other wakeups (e.g. a queued action) just repeat the flags test */
+      if (poll(fds, 1, (int)wait) > 0)
+        while (read(wakeup.thread[0], buf, sizeof(buf)) > 0)
+          ;
+    } else {
+      struct timespec t;
+
+      /* The thread blocks the signals => sleep in short slices to notice the flags */
+      if (wait > 1000)
+        wait = 1000;
+      t.tv_sec  = wait / 1000;
+      t.tv_nsec = (wait % 1000) * 1000000L;
+      nanosleep(&t, NULL);
+    }
+  }
+}
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+/**
+ * Get the monotonic time, the wall clock may step
+ * @return The time [ms]
+ */
+static long long get_time() {
+  struct timeval t;
+#ifdef HAVE_CLOCK_GETTIME
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+  gettimeofday(&t, NULL);
+  return (long long)t.tv_sec * 1000 + t.tv_usec / 1000;
+}
+
+
+/**
+ * Open the wakeup descriptors of the daemon and of the helper thread
+ * (M/Monit heartbeat). Each waiter drains its own descriptor, so one
+ * notification wakes both. If it fails the daemon falls back to a
+ * plain sleep interrupted by the signals only.
+ */
+static void init_wakeup() {
+  if (! (wakeup.ready = open_wakeup(wakeup.fd)))
+    LogError("%s: Cannot create the daemon wakeup pipe -- %s\n", prog, STRERROR);
+  if (! (wakeup.threadready = open_wakeup(wakeup.thread)))
+    LogError("%s: Cannot create the heartbeat wakeup pipe -- %s\n", prog, STRERROR);
+}
+
+
+/**
+ * Open the non-blocking wakeup descriptors, an eventfd if available,
+ * otherwise a pipe
+ * @param fd The read and write end
+ * @return TRUE if succeeded, otherwise FALSE
+ */
+static int open_wakeup(int fd[2]) {
+  int i;
+
+#ifdef HAVE_SYS_EVENTFD_H
+  if ((fd[0] = eventfd(0, 0)) >= 0) {
+    fd[1] = fd[0];
+  } else
+#endif
+  if (pipe(fd) < 0)
+    return FALSE;
+  for (i = 0; i < 2; i++) {
+    fcntl(fd[i], F_SETFL, fcntl(fd[i], F_GETFL, 0) | O_NONBLOCK);
+    fcntl(fd[i], F_SETFD, FD_CLOEXEC);
+  }
+  return TRUE;
+}
+
+
+/**
+ * Move the heap entry down to its position
+ * @param i The heap index
+ */
+static void sift_down(int i) {
+  Service_T s = schedule.heap[i];
+
+  for (;;) {
+    int child = 2 * i + 1;
+
+    if (child >= schedule.count)
+      break;
+    if (child + 1 < schedule.count && schedule.heap[child + 1]->deadline < schedule.heap[child]->deadline)
+      child++;
+    if (schedule.heap[child]->deadline >= s->deadline)
+      break;
+    schedule.heap[i] = schedule.heap[child];
+    i = child;
+  }
+  schedule.heap[i] = s;
+}
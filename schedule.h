@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2011 Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+
+
+#ifndef MONIT_SCHEDULE_H
+#define MONIT_SCHEDULE_H
+
+
+/**
+ *  Schedule the service checks. Every service has its own check
+ *  interval, the poll cycle by default, "every <n> cycles" or an
+ *  explicit "every <n> <milliseconds|seconds|minutes|hours>". The next
+ *  check deadlines are kept in a min-heap on the monotonic clock and
+ *  the daemon sleeps until the earliest one. The first deadline of
+ *  every service gets a random phase so the checks with the same
+ *  interval don't all run at the same instant.
+ *
+ *  The due services are still checked in the service list order, so
+ *  the dependency ordering is kept.
+ *
+ *  The daemon waits on one wakeup descriptor (eventfd or self-pipe)
+ *  with the time left to the earliest deadline as the timeout, any
+ *  thread or signal handler can wake it. The M/Monit heartbeat thread
+ *  waits on a descriptor of its own which is notified at the same time,
+ *  so a stop or reload wakes it immediately too.
+ *
+ *  @file
+ */
+
+
+/**
+ * Compute the check intervals and build the deadline heap of all
+ * services. All services are due for the first validation.
+ */
+void Schedule_init();
+
+
+/**
+ * Free the deadline heap. Without the heap every service is due on
+ * each validation (e.g. for the validate command).
+ */
+void Schedule_free();
+
+
+/**
+ * Mark the services whose deadline passed as due and advance their
+ * deadlines by the check interval. A service whose watched process
+ * exited is due too, its deadline is kept.
+ * @return TRUE if some process or system service is due (the process
+ * table is needed), otherwise FALSE
+ */
+int Schedule_update();
+
+
+/**
+ * Mark all services as due on the next validation, for example when
+ * the daemon was awakened. The deadlines are kept.
+ */
+void Schedule_wakeup();
+
+
+/**
+ * Sleep until the earliest deadline or until Schedule_notify() is
+ * called. A signal interrupts the sleep too.
+ */
+void Schedule_sleep();
+
+
+/**
+ * Sleep in a helper thread (M/Monit heartbeat) until the timeout passes
+ * or the daemon is stopped or reloaded. Schedule_init() opens the
+ * wakeup descriptors, the thread has to be started after it.
+ * @param timeout The maximal sleep time [ms]
+ */
+void Schedule_wait(int timeout);
+
+
+/**
+ * Wake up the sleeping daemon and the helper thread, for example when an action is queued.
+ * This function is async-signal-safe, the signal handlers, the http
+ * thread and the process exit watcher call it after setting the flag
+ * which tells the daemon what to do.
+ */
+void Schedule_notify();
+
+
+#endif
@@ -132,12 +132,14 @@
 #include "alert.h"
 #include "process.h"
 #include "event.h"
+#include "sampler.h"
 
 
 /* Private prototypes */
 static char   x2c(char *hex);
 static char  *is_str_defined(char *);
 static void   printevents(unsigned int);
+static unsigned int hash_name(const char *);
 #ifdef HAVE_LIBPAM
 #ifdef SOLARIS
 static int    PAMquery(int, struct pam_message **, struct pam_response **, void *);
@@ -155,6 +157,14 @@ struct ad_user {
 };
 
 
+/* Case-insensitive service name index, open addressing, at most half full */
+static struct myserviceindex {
+  Service_T *table;                                /**< Index slots, 2^n */
+  int        size;                                  /**< Number of slots */
+  int        count;                          /**< Number of indexed names */
+} serviceindex;
+
+
 /* Unsafe URL characters: <>\"#%{}|\\^[] ` */
 static const unsigned char urlunsafe[256] = {
         1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 
@@ -502,11 +512,23 @@ char *Util_digest2Bytes(unsigned char *digest, int mdlen, MD_T result) {
 
 
 Service_T Util_getService(const char *name) {
+  unsigned int i;
+  unsigned int mask;
   Service_T s;
 
   ASSERT(name);
 
-  for(s= servicelist; s; s= s->next) {
+  if(! serviceindex.table) {
+    for(s= servicelist; s; s= s->next) {
+      if(IS(s->name, name)) {
+        return s;
+      }
+    }
+    return NULL;
+  }
+
+  mask= serviceindex.size - 1;
+  for(i= hash_name(name) & mask; (s= serviceindex.table[i]); i= (i + 1) & mask) {
     if(IS(s->name, name)) {
       return s;
     }
@@ -515,6 +537,46 @@ Service_T Util_getService(const char *name) {
 }
 
 
+void Util_indexService(Service_T s) {
+  unsigned int i;
+  unsigned int mask;
+
+  ASSERT(s);
+  ASSERT(s->name);
+
+  if(2 * (serviceindex.count + 1) > serviceindex.size) {
+    Service_T *old= serviceindex.table;
+    int oldsize= serviceindex.size;
+    int j;
+
+    serviceindex.size= oldsize ? 2 * oldsize : 64;
+    serviceindex.table= xcalloc(sizeof(Service_T), serviceindex.size);
+    mask= serviceindex.size - 1;
+    for(j= 0; j < oldsize; j++) {
+      if(old[j]) {
+        for(i= hash_name(old[j]->name) & mask; serviceindex.table[i]; i= (i + 1) & mask)
+          ;
+        serviceindex.table[i]= old[j];
+      }
+    }
+    FREE(old);
+  }
+
+  mask= serviceindex.size - 1;
+  for(i= hash_name(s->name) & mask; serviceindex.table[i]; i= (i + 1) & mask)
+    ;
+  serviceindex.table[i]= s;
+  serviceindex.count++;
+}
+
+
+void Util_resetServiceIndex() {
+  FREE(serviceindex.table);
+  serviceindex.size= 0;
+  serviceindex.count= 0;
+}
+
+
 int Util_getNumberOfServices() {
   int i= 0;
   Service_T s;
@@ -685,6 +747,8 @@ void Util_printService(Service_T s) {
       printf(" %-20s = %s\n", "Match", s->path);
     else
       printf(" %-20s = %s\n", "Pid file", s->path);
+    if (s->cgroup)
+      printf(" %-20s = %s\n", "Cgroup", s->cgroup->path ? s->cgroup->path : "of the process");
   } else if(s->type != TYPE_HOST && s->type != TYPE_SYSTEM) {
     printf(" %-20s = %s\n", "Path", s->path);
   }
@@ -931,6 +995,14 @@ void Util_printService(Service_T s) {
         printf(" %-20s = ", "CPU wait limit");
         break;
 
+      case RESOURCE_ID_CPUSTEAL: 
+        printf(" %-20s = ", "CPU steal limit");
+        break;
+
+      case RESOURCE_ID_CPUCORE: 
+        printf(" %-20s = ", "CPU core limit");
+        break;
+
       case RESOURCE_ID_MEM_PERCENT: 
         printf(" %-20s = ", "Memory usage limit");
         break;
@@ -970,6 +1042,11 @@ void Util_printService(Service_T s) {
       case RESOURCE_ID_TOTAL_MEM_PERCENT:
         printf(" %-20s = ", "Memory usage limit (incl. children)");
         break;
+
+      default:
+        if (IS_RESOURCE_PRESSURE(q->resource_id))
+          printf(" %-20s = ", pressurenames[q->resource_id - RESOURCE_ID_PRESSURE]);
+        break;
     }
     switch(q->resource_id) {
       case RESOURCE_ID_CPU_PERCENT: 
@@ -978,9 +1055,13 @@ void Util_printService(Service_T s) {
       case RESOURCE_ID_CPUUSER: 
       case RESOURCE_ID_CPUSYSTEM: 
       case RESOURCE_ID_CPUWAIT: 
+      case RESOURCE_ID_CPUSTEAL: 
+      case RESOURCE_ID_CPUCORE: 
       case RESOURCE_ID_MEM_PERCENT: 
       case RESOURCE_ID_SWAP_PERCENT: 
-        printf("if %s %.1f%% %s ", operatornames[q->operator], q->limit / 10.0, Util_getEventratio(a->failed, buf, sizeof(buf)));
+      default: /* pressure stall */
+        printf("if%s ", Sampler_describe(q, buf, sizeof(buf)));
+        printf("%s %.1f%% %s ", operatornames[q->operator], q->limit / 10.0, Util_getEventratio(a->failed, buf, sizeof(buf)));
         printf("then %s ", Util_describeAction(a->failed, buf, sizeof(buf)));
         printf("else if succeeded %s ", Util_getEventratio(a->succeeded, buf, sizeof(buf)));
         printf("then %s", Util_describeAction(a->succeeded, buf, sizeof(buf)));
@@ -1016,6 +1097,8 @@ void Util_printService(Service_T s) {
 
   if(s->def_every)
     printf(" %-20s = Check service every %d cycles\n", "Every", s->every);
+  else if(s->interval)
+    printf(" %-20s = Check service every %d ms\n", "Every", s->interval);
   
   for (ar = s->actionratelist; ar; ar = ar->next)
     printf(" %-20s = If restarted %d times within %d cycle(s) then %s\n", "Timeout", ar->count, ar->cycle, Util_describeAction(ar->action->failed, buf, sizeof(buf)));
@@ -1160,7 +1243,6 @@ pid_t Util_getPid(char *pidfile) {
 
 
 int Util_isProcessRunning(Service_T s, int refresh) {
-  int   i;
   pid_t pid = -1;
   
   ASSERT(s);
@@ -1168,28 +1250,15 @@ int Util_isProcessRunning(Service_T s, int refresh) {
   errno = 0;
 
   if (refresh || ! ptree || ! ptreesize)
-    initprocesstree(&ptree, &ptreesize, &oldptree, &oldptreesize);
+    initprocesstree(&ptree, &ptreesize);
 
   if (s->matchlist) {
     /* The process table read may sporadically fail during read, because we're using glob on some platforms which may fail if the proc filesystem
      * which it traverses is changed during glob (process stopped). Note that the glob failure is rare and temporary - it will be OK on next cycle.
      * We skip the process matching that cycle however because we don't have process informations - will retry next cycle */
     if (Run.doprocess) {
-      for (i = 0; i < ptreesize; i++) {
-        int found = FALSE;
-
-        if (ptree[i].cmdline) {
-#ifdef HAVE_REGEX_H
-          found = regexec(s->matchlist->regex_comp, ptree[i].cmdline, 0, NULL, 0) ? FALSE : TRUE;
-#else
-          found = strstr(ptree[i].cmdline, s->matchlist->match_string) ? TRUE : FALSE;
-#endif
-        }
-        if (found) {
-          pid = ptree[i].pid;
-          break;
-        }
-      }
+      /* The first matching process is resolved for all services by the process tree update */
+      pid = s->matchpid;
     } else {
         DEBUG("Process information not available -- skipping service %s process existence check for this cycle\n", s->name);
         /* Return value is NOOP - it is based on existing errors bitmap so we don't generate false recovery/failures */
@@ -1897,8 +1966,7 @@ void Util_monitorUnset(Service_T s) {
   s->nstart= 0;
   s->ncycle= 0;
   s->error = Event_Null;
-  if(s->eventlist)
-    gc_event(&s->eventlist);
+  Event_clear(s);
   Util_resetInfo(s);
 }
 
@@ -2046,6 +2114,20 @@ static char *is_str_defined(char *s) {
 }
 
 
+/**
+ * Case-insensitive FNV-1a hash of the service name
+ */
+static unsigned int hash_name(const char *name) {
+  unsigned int h= 2166136261U;
+
+  for(; *name; name++) {
+    h^= (unsigned char)tolower((unsigned char)*name);
+    h*= 16777619U;
+  }
+  return h;
+}
+
+
 /**
  * Convert a hex char to a char
  */
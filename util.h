@@ -190,6 +190,22 @@ char *Util_digest2Bytes(unsigned char *digest, int mdlen, MD_T result);
 Service_T Util_getService(const char *name);
 
 
+/**
+ * Add the service to the case-insensitive name index used by
+ * Util_getService(). The parser indexes every service it adds.
+ * @param s A service
+ */
+void Util_indexService(Service_T s);
+
+
+/**
+ * Drop the service name index, it must be reset whenever the service
+ * list is released. Without the index Util_getService() scans the
+ * service list.
+ */
+void Util_resetServiceIndex();
+
+
 /**
  * @param name A service name as stated in the config file
  * @return TRUE if the service name exist in the
@@ -91,6 +91,8 @@
 #include "device.h"
 #include "process.h"
 #include "protocol.h"
+#include "sampler.h"
+#include "schedule.h"
 
 
 /**
@@ -111,6 +113,16 @@
 #define MATCH_LINE_LENGTH 512
 
 
+/** The connection tests of one validation run by the worker threads */
+static struct myprobes {
+  Service_T *service;                       /**< Services to be probed */
+  int        count;                         /**< Number of the services */
+  int        next;                 /**< Index of the next service to probe */
+} probes;
+
+static pthread_mutex_t probesMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
 /* -------------------------------------------------------------- Prototypes */
 
 
@@ -129,9 +141,20 @@ static void check_process_state(Service_T);
 static void check_process_pid(Service_T);
 static void check_process_ppid(Service_T);
 static void check_connection(Service_T, Port_T);
+static int  probe_connection(Service_T, Port_T, double *, char *);
+static int  probe_candidate(Service_T);
+static int  probe_eligible(Service_T);
+static void probe_prepare(void);
+static void probe_service(Service_T);
+static void probe_services(void);
+static int  connect_eligible(Port_T);
+static void connect_services(void);
+static void *probe_thread(void *);
+static void probe_reset(void);
 static void check_filesystem_flags(Service_T);
 static void check_filesystem_resources(Service_T, Filesystem_T);
 static void check_process_resources(Service_T, Resource_T);
+static void check_resource_sample(Service_T, Resource_T);
 static int  do_scheduled_action(Service_T);
 
 
@@ -150,8 +173,11 @@ int validate() {
   Run.handler_flag = HANDLER_SUCCEEDED;
   Event_queue_process();
 
-  initprocesstree(&ptree, &ptreesize, &oldptree, &oldptreesize);
-  gettimeofday(&systeminfo.collected, NULL);
+  /* The process table is read only if some service needs it */
+  if (Schedule_update() || Run.doaction) {
+    initprocesstree(&ptree, &ptreesize);
+    gettimeofday(&systeminfo.collected, NULL);
+  }
 
   /* In the case that at least one action is pending, perform quick
    * loop to handle the actions ASAP */
@@ -161,8 +187,19 @@ int validate() {
       do_scheduled_action(s);
   }
 
-  /* Check the services */
+  /* Run the slow connection tests of the independent services concurrently */
+  probe_prepare();
+  connect_services();
+  probe_services();
+
+  /* Check the due services in the service list order, the events are
+   * posted here, so their order doesn't depend on the worker threads */
   for (s = servicelist; s && !Run.stopped; s = s->next) {
+    if (! s->due) {
+      do_scheduled_action(s);
+      continue;
+    }
+    s->due = FALSE;
     if (! do_scheduled_action(s) && s->monitor && ! check_skip(s)) {
       check_timeout(s); // Can disable monitoring => need to check s->monitor again
       if (s->monitor) {
@@ -177,6 +214,7 @@ int validate() {
     gettimeofday(&s->collected, NULL);
   }
 
+  probe_reset();
   reset_depend();
 
   return errors;
@@ -202,6 +240,9 @@ int check_process(Service_T s) {
   } else
     Event_post(s, Event_Nonexist, STATE_SUCCEEDED, s->action_NONEXIST, "process is running with pid %d", (int)pid);
 
+  /* Validate the service as soon as the process exits */
+  watchprocess(s, (int)pid);
+
   if (Run.doprocess) {
     if (update_process_data(s, ptree, ptreesize, pid)) {
       check_process_state(s);
@@ -474,7 +515,10 @@ int check_remote_host(Service_T s) {
       switch(icmp->type) {
       case ICMP_ECHO:
 
-        icmp->response = icmp_echo(s->path, icmp->timeout, icmp->count);
+        /* The ping is run by probe_eligible() if the ports are tested early */
+        if (! icmp->done)
+          icmp->response = icmp_echo(s->path, icmp->timeout, icmp->count);
+        icmp->done = FALSE;
 
         if (icmp->response == -2) {
           icmp->is_available = TRUE;
@@ -537,18 +581,52 @@ int check_system(Service_T s) {
 
 
 /**
- * Test the connection and protocol
+ * Test the connection and protocol. The result of the connection test
+ * run by a worker thread is used if available.
  */
 static void check_connection(Service_T s, Port_T p) {
+  char buf[STRLEN];
+
+  ASSERT(s && p);
+
+  if (! p->probe.done)
+    p->probe.ok = probe_connection(s, p, &p->probe.response, p->probe.report);
+  p->probe.done = FALSE;
+
+  if (! p->probe.ok) {
+    p->response = -1;
+    p->is_available = FALSE;
+    Event_post(s, Event_Connection, STATE_FAILED, p->action, "%s", p->probe.report);
+  } else {
+    p->response = p->probe.response;
+    p->is_available = TRUE;
+    Event_post(s, Event_Connection, STATE_SUCCEEDED, p->action, "connection succeeded to %s", Util_portDescription(p, buf, sizeof(buf)));
+  }
+      
+}
+
+
+/**
+ * Connect to the port and run the protocol test. This function doesn't
+ * post any event, it may run in a worker thread.
+ * @param s The service
+ * @param p The port
+ * @param response The response time [s]
+ * @param report The error description buffer [STRLEN]
+ * @return TRUE if the test succeeded otherwise FALSE
+ */
+static int probe_connection(Service_T s, Port_T p, double *response, char *report) {
   Socket_T socket;
   volatile int rv = TRUE;
   char buf[STRLEN];
-  char report[STRLEN] = {0};
   struct timeval t1;
   struct timeval t2;
 
   ASSERT(s && p);
 
+  *report = 0;
+  *response = -1;
+
   /* Get time of connection attempt beginning */
   gettimeofday(&t1, NULL);
 
@@ -583,21 +661,252 @@ static void check_connection(Service_T s, Port_T p) {
   gettimeofday(&t2, NULL);
 
   /* Get the response time */
-  p->response = (double)(t2.tv_sec - t1.tv_sec) + (double)(t2.tv_usec - t1.tv_usec)/1000000;
+  *response = (double)(t2.tv_sec - t1.tv_sec) + (double)(t2.tv_usec - t1.tv_usec)/1000000;
 
   error:
   if (socket)
     socket_free(&socket);
 
-  if (!rv) {
-    p->response = -1;
-    p->is_available = FALSE;
-    Event_post(s, Event_Connection, STATE_FAILED, p->action, report);
-  } else {
-    p->is_available = TRUE;
-    Event_post(s, Event_Connection, STATE_SUCCEEDED, p->action, "connection succeeded to %s", Util_portDescription(p, buf, sizeof(buf)));
+  return rv;
+}
+
+
+/**
+ * Run the connection tests of the service in the worker thread. Only
+ * the probe result of the port is written, the service state seen by
+ * the http thread is updated by check_connection() in the main thread.
+ */
+static void probe_service(Service_T s) {
+  Port_T p;
+
+  for (p = s->portlist; p; p = p->next) {
+    if (! p->probe.done) {
+      p->probe.ok = probe_connection(s, p, &p->probe.response, p->probe.report);
+      p->probe.done = TRUE;
+    }
+  }
+}
+
+
+/**
+ * The services which depend on other services are left for the serial
+ * check, they may be affected by actions done on their dependencies.
+ * @return TRUE if the connection tests of the service may be run
+ * before the service is checked, if its pre-checks pass
+ */
+static int probe_candidate(Service_T s) {
+  return (s->due && s->monitor && s->portlist && ! s->dependantlist && s->doaction == ACTION_IGNORE);
+}
+
+
+/**
+ * The ports of a process which is not running and of a host which
+ * doesn't answer the ping are not tested by the check either, so they
+ * are not connected at all. The hosts are pinged here one after
+ * another, the results are posted by check_remote_host().
+ * @return TRUE if the connection tests of the service are run before
+ * the service is checked
+ */
+static int probe_eligible(Service_T s) {
+  Icmp_T icmp;
+
+  if (! probe_candidate(s))
+    return FALSE;
+  switch (s->type) {
+    case TYPE_PROCESS:
+      return (Util_isProcessRunning(s, FALSE) > 0);
+    case TYPE_HOST:
+      for (icmp = s->icmplist; icmp; icmp = icmp->next) {
+        if (icmp->type == ICMP_ECHO) {
+          icmp->response = icmp_echo(s->path, icmp->timeout, icmp->count);
+          icmp->done = TRUE;
+        }
+        /* The last ping decides as in check_remote_host() */
+        if (! icmp->next && icmp->done && icmp->response == -1)
+          return FALSE;
+      }
+      return TRUE;
+    default:
+      return TRUE;
+  }
+}
+
+
+/**
+ * Select the services whose connection tests are run before the
+ * service list is checked
+ */
+static void probe_prepare() {
+  Service_T s;
+
+  for (s = servicelist; s; s = s->next)
+    s->probe = ! Run.stopped && probe_eligible(s);
+}
+
+
+/**
+ * Run the connection tests of the due services concurrently by up to
+ * Run.connectionthreads threads. The ports already tested by
+ * connect_services() are skipped.
+ */
+static void probe_services() {
+  int        i;
+  int        n;
+  int        status;
+  pthread_t *threads;
+  Service_T  s;
+
+  if (Run.connectionthreads <= 1)
+    return;
+
+  probes.count = 0;
+  for (s = servicelist; s; s = s->next)
+    if (s->probe)
+      probes.count++;
+  if (probes.count < 2)
+    return;
+
+  probes.service = xcalloc(sizeof(Service_T), probes.count);
+  probes.next = 0;
+  for (i = 0, s = servicelist; s; s = s->next)
+    if (s->probe)
+      probes.service[i++] = s;
+
+  n = MIN(Run.connectionthreads, probes.count);
+  threads = xcalloc(sizeof(pthread_t), n);
+  for (i = 0; i < n; i++) {
+    if ((status = pthread_create(&threads[i], NULL, probe_thread, NULL)) != 0) {
+      LogError("%s: Failed to create the connection test thread -- %s\n", prog, strerror(status));
+      break;
+    }
+  }
+  /* The services which were not probed by a worker are probed by check_connection() */
+  while (i-- > 0)
+    pthread_join(threads[i], NULL);
+
+  FREE(threads);
+  FREE(probes.service);
+  probes.count = 0;
+}
+
+
+/**
+ * @return TRUE if the port test can be run by probe_ports(): a TCP, UDP
+ * or UNIX socket port without a protocol test or a TCP or UNIX socket
+ * port with the generic or HTTP test, all without SSL
+ */
+static int connect_eligible(Port_T p) {
+  if (p->SSL.use_ssl)
+    return FALSE;
+  if (p->protocol->check == check_default)
+    return TRUE;
+  return ((p->protocol->check == check_generic || p->protocol->check == check_http) && (p->family == AF_UNIX || p->type == SOCK_STREAM));
+}
+
+
+/**
+ * Test the ports of the due services which don't need a blocking
+ * protocol test at once. The connects and the send/expect and HTTP
+ * tests are run in parallel, so the cycle takes about as long as the
+ * slowest port. The ports with other protocol tests or SSL are left
+ * for probe_services().
+ */
+static void connect_services() {
+  int        i;
+  int        count = 0;
+  char       buf[STRLEN];
+  Probe_T   *probes;
+  Port_T     p;
+  Service_T  s;
+
+  for (s = servicelist; s; s = s->next)
+    if (s->probe)
+      for (p = s->portlist; p; p = p->next)
+        if (connect_eligible(p))
+          count++;
+  if (! count)
+    return;
+
+  probes = xcalloc(sizeof(Probe_T), count);
+  for (i = 0, s = servicelist; s; s = s->next)
+    if (s->probe)
+      for (p = s->portlist; p; p = p->next)
+        if (connect_eligible(p)) {
+          NEW(probes[i]);
+          probes[i]->port = p;
+          if (p->protocol->check == check_generic)
+            probes[i]->step = probe_generic;
+          else if (p->protocol->check == check_http)
+            probes[i]->step = probe_http;
+          i++;
+        }
+
+  if (probe_ports(probes, count)) {
+    for (i = 0; i < count; i++) {
+      Probe_T P = probes[i];
+
+      p = P->port;
+      p->probe.done     = TRUE;
+      p->probe.ok       = ! P->failed;
+      p->probe.response = P->response;
+      if (! P->connected)
+        snprintf(p->probe.report, STRLEN, "failed, cannot open a connection to %s -- %s", Util_portDescription(p, buf, sizeof(buf)), strerror(P->error));
+      else if (P->failed && ! P->step)
+        snprintf(p->probe.report, STRLEN, "connection failed, %s is not ready for i|o -- %s", Util_portDescription(p, buf, sizeof(buf)), strerror(P->error));
+      else if (P->failed)
+        snprintf(p->probe.report, STRLEN, "failed protocol test [%s] at %s", p->protocol->name, Util_portDescription(p, buf, sizeof(buf)));
+      else
+        *p->probe.report = 0;
+    }
+  }
+
+  for (i = 0; i < count; i++)
+    FREE(probes[i]);
+  FREE(probes);
+}
+
+
+/**
+ * The connection test worker thread - probes the services until none
+ * is left
+ * @param args Not used
+ */
+static void *probe_thread(void *args) {
+  sigset_t  ns;
+  Service_T s;
+
+  set_signal_block(&ns, NULL);
+  for (;;) {
+    s = NULL;
+    LOCK(probesMutex)
+    {
+      if (probes.next < probes.count)
+        s = probes.service[probes.next++];
+    }
+    END_LOCK;
+    if (! s)
+      break;
+    probe_service(s);
+  }
+  return NULL;
+}
+
+
+/**
+ * Drop the connection test and ping results which were not used, for
+ * example if the monitoring was stopped before the service was checked
+ */
+static void probe_reset() {
+  Icmp_T    icmp;
+  Port_T    p;
+  Service_T s;
+
+  for (s = servicelist; s; s = s->next) {
+    for (p = s->portlist; p; p = p->next)
+      p->probe.done = FALSE;
+    for (icmp = s->icmplist; icmp; icmp = icmp->next)
+      icmp->done = FALSE;
   }
-      
 }
 
 
@@ -664,6 +973,11 @@ static void check_process_resources(Service_T s, Resource_T r) {
 
   ASSERT(s && r);
 
+  if (r->statistic != SAMPLE_NONE) {
+    check_resource_sample(s, r);
+    return;
+  }
+
   switch(r->resource_id) {
 
   case RESOURCE_ID_CPU_PERCENT:
@@ -716,6 +1030,26 @@ static void check_process_resources(Service_T s, Resource_T r) {
       snprintf(report, STRLEN, "'%s' cpu wait usage check succeeded [current cpu wait usage=%.1f%%]", s->name, systeminfo.total_cpu_wait_percent/10.0);
     break;
 
+  case RESOURCE_ID_CPUSTEAL:
+    if (s->monitor == MONITOR_INIT || systeminfo.total_cpu_steal_percent < 0) {
+      DEBUG("'%s' cpu steal usage check skipped (initializing)\n", s->name);
+    } else if (Util_evalQExpression(r->operator, systeminfo.total_cpu_steal_percent, r->limit)) {
+      snprintf(report, STRLEN, "cpu steal usage of %.1f%% matches resource limit [cpu steal usage%s%.1f%%]", systeminfo.total_cpu_steal_percent/10.0, operatorshortnames[r->operator], r->limit/10.0);
+      okay = FALSE;
+    } else
+      snprintf(report, STRLEN, "'%s' cpu steal usage check succeeded [current cpu steal usage=%.1f%%]", s->name, systeminfo.total_cpu_steal_percent/10.0);
+    break;
+
+  case RESOURCE_ID_CPUCORE:
+    if (s->monitor == MONITOR_INIT || systeminfo.cpu_max_percent < 0) {
+      DEBUG("'%s' cpu core usage check skipped (initializing)\n", s->name);
+    } else if (Util_evalQExpression(r->operator, systeminfo.cpu_max_percent, r->limit)) {
+      snprintf(report, STRLEN, "cpu core %d usage of %.1f%% matches resource limit [cpu core usage%s%.1f%%]", systeminfo.cpu_max, systeminfo.cpu_max_percent/10.0, operatorshortnames[r->operator], r->limit/10.0);
+      okay = FALSE;
+    } else
+      snprintf(report, STRLEN, "'%s' cpu core usage check succeeded [current busiest cpu core %d usage=%.1f%%]", s->name, systeminfo.cpu_max, systeminfo.cpu_max_percent/10.0);
+    break;
+
   case RESOURCE_ID_MEM_PERCENT:
     if (s->type == TYPE_SYSTEM) {
       if (Util_evalQExpression(r->operator, systeminfo.total_mem_percent, r->limit)) {
@@ -817,6 +1151,19 @@ static void check_process_resources(Service_T s, Resource_T r) {
     break;
 
   default:
+    if (IS_RESOURCE_PRESSURE(r->resource_id)) {
+      int         pressure = systeminfo.pressure[r->resource_id - RESOURCE_ID_PRESSURE];
+      const char *name     = pressurenames[r->resource_id - RESOURCE_ID_PRESSURE];
+
+      if (pressure < 0) {
+        DEBUG("'%s' %s check skipped (not available)\n", s->name, name);
+      } else if (Util_evalQExpression(r->operator, pressure, r->limit)) {
+        snprintf(report, STRLEN, "%s of %.1f%% matches resource limit [%s%s%.1f%%]", name, pressure/10.0, name, operatorshortnames[r->operator], r->limit/10.0);
+        okay = FALSE;
+      } else
+        snprintf(report, STRLEN, "'%s' %s check succeeded [current %s=%.1f%%]", s->name, name, name, pressure/10.0);
+      break;
+    }
     LogError("'%s' error -- unknown resource ID: [%d]\n", s->name, r->resource_id);
     return;
   }
@@ -831,6 +1178,36 @@ static void check_process_resources(Service_T s, Resource_T r) {
 }
 
 
+/**
+ * Test the statistic of the resource samples collected by the sampler
+ * thread in the resource window
+ */
+static void check_resource_sample(Service_T s, Resource_T r) {
+  int   value;
+  char *name;
+  char  statistic[STRLEN];
+
+  ASSERT(s && r);
+
+  switch (r->resource_id) {
+    case RESOURCE_ID_CPUUSER:   name = "cpu user usage";   break;
+    case RESOURCE_ID_CPUSYSTEM: name = "cpu system usage"; break;
+    case RESOURCE_ID_CPUWAIT:   name = "cpu wait usage";   break;
+    default:                    name = "cpu usage";        break;
+  }
+  Sampler_describe(r, statistic, sizeof(statistic));
+
+  if (! Sampler_getStatistic(s, r, &value)) {
+    DEBUG("'%s' %s%s check skipped (no samples)\n", s->name, name, statistic);
+  } else if (Util_evalQExpression(r->operator, value, r->limit)) {
+    Event_post(s, Event_Resource, STATE_FAILED, r->action, "%s%s of %.1f%% matches resource limit [%s%s%.1f%%]", name, statistic, value/10.0, name, operatorshortnames[r->operator], r->limit/10.0);
+  } else {
+    DEBUG("'%s' %s%s check succeeded [current %s=%.1f%%]\n", s->name, name, statistic, name, value/10.0);
+    Event_post(s, Event_Resource, STATE_SUCCEEDED, r->action, "'%s' %s%s check succeeded [current %s=%.1f%%]", s->name, name, statistic, name, value/10.0);
+  }
+}
+
+
 /**
  * Test for associated path checksum change
  */
@@ -1300,14 +1677,6 @@ static int check_skip(Service_T s) {
     return TRUE;
   }
 
-  if (!s->def_every)
-    return FALSE;
-  
-  if (++s->nevery < s->every)
-    return TRUE;
-
-  s->nevery = 0;
-
   return FALSE;
 
 }
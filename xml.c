@@ -341,6 +341,16 @@ static void status_service(Service_T S, Buffer_T *B, short L, int V) {
   		  S->inf->priv.process.total_mem_kbyte,
   		  S->inf->priv.process.cpu_percent/10.0,
   		  S->inf->priv.process.total_cpu_percent/10.0);
+          if(S->cgroup && S->cgroup->current)
+            Util_stringbuffer(B,
+  		    "<cgroup>"
+  		    "<path>%s</path>"
+  		    "<read>%ld</read>"
+  		    "<write>%ld</write>"
+  		    "</cgroup>",
+  		    S->cgroup->current,
+  		    S->cgroup->read_rate,
+  		    S->cgroup->write_rate);
         }
       }
       if(S->type == TYPE_HOST && S->icmplist) {
@@ -401,6 +411,14 @@ static void status_service(Service_T S, Buffer_T *B, short L, int V) {
 					"<system>%.1f</system>"
 #ifdef HAVE_CPU_WAIT
 				        "<wait>%.1f</wait>"
+#endif
+#ifdef HAVE_CPU_STEAL
+					"<irq>%.1f</irq>"
+					"<steal>%.1f</steal>"
+					"<core>"
+					"<id>%d</id>"
+					"<percent>%.1f</percent>"
+					"</core>"
 #endif
 					"</cpu>"
 					"<memory>"
@@ -410,8 +428,7 @@ static void status_service(Service_T S, Buffer_T *B, short L, int V) {
                                         "<swap>"
                                         "<percent>%.1f</percent>"
                                         "<kilobyte>%ld</kilobyte>"
-                                        "</swap>"
-					"</system>",
+                                        "</swap>",
 					systeminfo.loadavg[0],
 					systeminfo.loadavg[1],
 					systeminfo.loadavg[2],
@@ -420,10 +437,46 @@ static void status_service(Service_T S, Buffer_T *B, short L, int V) {
 					#ifdef HAVE_CPU_WAIT
 					systeminfo.total_cpu_wait_percent > 0 ? systeminfo.total_cpu_wait_percent/10. : 0,
 					#endif
+					#ifdef HAVE_CPU_STEAL
+					systeminfo.total_cpu_irq_percent > 0 ? systeminfo.total_cpu_irq_percent/10. : 0,
+					systeminfo.total_cpu_steal_percent > 0 ? systeminfo.total_cpu_steal_percent/10. : 0,
+					systeminfo.cpu_max,
+					systeminfo.cpu_max_percent > 0 ? systeminfo.cpu_max_percent/10. : 0,
+					#endif
 					systeminfo.total_mem_percent/10.,
 					systeminfo.total_mem_kbyte,
                                         systeminfo.total_swap_percent/10.,
                                         systeminfo.total_swap_kbyte);
+#ifdef HAVE_PRESSURE
+        if(systeminfo.pressure[PRESSURE_INDEX(PRESSURE_CPU, PRESSURE_SOME, PRESSURE_AVG10)] >= 0 ||
+           systeminfo.pressure[PRESSURE_INDEX(PRESSURE_MEMORY, PRESSURE_SOME, PRESSURE_AVG10)] >= 0 ||
+           systeminfo.pressure[PRESSURE_INDEX(PRESSURE_IO, PRESSURE_SOME, PRESSURE_AVG10)] >= 0) {
+          int i, kind;
+
+          Util_stringbuffer(B, "<pressure>");
+          for(i = PRESSURE_CPU; i <= PRESSURE_IO; i++) {
+            Util_stringbuffer(B, "<%s>", pressureresourcenames[i]);
+            for(kind = PRESSURE_SOME; kind <= PRESSURE_FULL; kind++) {
+              int *avg = &systeminfo.pressure[PRESSURE_INDEX(i, kind, PRESSURE_AVG10)];
+
+              if(avg[0] < 0)
+                continue;
+              Util_stringbuffer(B,
+                "<%s>"
+                "<avg10>%.1f</avg10>"
+                "<avg60>%.1f</avg60>"
+                "<avg300>%.1f</avg300>"
+                "</%s>",
+                kind == PRESSURE_SOME ? "some" : "full",
+                avg[0]/10., avg[1]/10., avg[2]/10.,
+                kind == PRESSURE_SOME ? "some" : "full");
+            }
+            Util_stringbuffer(B, "</%s>", pressureresourcenames[i]);
+          }
+          Util_stringbuffer(B, "</pressure>");
+        }
+#endif
+        Util_stringbuffer(B, "</system>");
       }
     }
   }